@@ -4,10 +4,57 @@
 #include <string.h>
 #include <time.h>
 #include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/select.h>
+#include <fcntl.h>
+#include <errno.h>
+#endif
+
+#ifndef _MSC_VER
+#include <stdatomic.h>
+#endif
 
 #define SHELF_CAPACITY 50
 #define WARNING_THRESHOLD 0.8
-#define BASE_PRICE 10.0
+#define BASE_PRICE 1000           // 基础价格（分）
+#define SECONDS_PER_DAY 86400
+#define STORAGE_FREE_DAYS 3    // 免费保管天数
+#define STORAGE_DAILY_FEE 100  // 超期后每日保管费（分）
+#define OVERDUE_DAYS 7         // 超过该天数未取视为滞留件
+#define ACCRUAL_INTERVAL_MS 60000 // 后台计提保管费的间隔
+#define PICKUP_CODE_SIZE 12    // 取件码缓冲区（10位编码+结束符，留有余量）
+
+// 金额类型：以分为单位的64位整数，求和结果与累加顺序无关
+typedef int64_t money_t;
+
+#define MONEY_YUAN(cents) ((cents) / 100.0) // 仅用于显示
+#define DATA_FORMAT_VERSION 4                // 2: 金额字段由double(元)改为money_t(分) 3: 包裹增加运单号、取件码加长 4: 包裹增加超期保管费
+
+// 元转分（四舍五入）
+money_t money_from_yuan(double yuan) {
+    return (money_t)llround(yuan * 100);
+}
+
+// 按百分比折算金额（四舍五入到分）
+money_t money_percent(money_t cents, int percent) {
+    money_t scaled = cents * percent;
+    return scaled >= 0 ? (scaled + 50) / 100 : -((-scaled + 50) / 100);
+}
 
 // 枚举定义
 typedef enum {
@@ -48,7 +95,7 @@ typedef struct User {
     char name[50];
     char phone[20];
     int membership; // 0-新 1-白银 2-黄金
-    double total_spent;
+    money_t total_spent;  // 累计消费（分）
     time_t last_purchase;
     int purchase_count;
     struct User* next;
@@ -57,24 +104,26 @@ typedef struct User {
 typedef struct Package {
     int id;
     int user_id;  // 用户关联字段
-    double content_value; // 包裹内容物价值
+    money_t content_value; // 包裹内容物价值（分）
     PackageSize size;     // 包裹尺寸
     PackageWeight weight; // 包裹重量 
     SpecialFlags special; // 特殊标志
     ShippingMethod shipping; // 运输方式
     char shelf_code[10];  // 货架编码
-    char pickup_code[10]; // 取件码
+    char pickup_code[PICKUP_CODE_SIZE]; // 取件码
+    char tracking_no[24]; // 承运商运单号（手动录入可为空）
     time_t arrival;       // 入库时间
     time_t pickup;        // 出库时间
     int status;           // 包裹状态
-    double storage_fee;   // 存储费用
+    money_t storage_fee;  // 存储费用（分）
+    money_t accrued_fee;  // 超期保管费（分），计提时累加，出库时与存储费用一并收取
     struct Package* next; // 链表指针
 } Package;
 
 // 财务记录
 typedef struct Finance {
     int type; // 1-计件费 2-派送费 3-保存费
-    double amount;
+    money_t amount; // 金额（分）
     time_t timestamp;
     struct Finance* next;
 } Finance;
@@ -84,14 +133,40 @@ User* users = NULL;
 Package* packages = NULL;
 Finance* finances = NULL;
 
+// 随操作增量维护的汇总值（持有store_mutex读写），查询时无需遍历链表
+static int stock_counts[5];      // 各尺寸在库数量
+static money_t member_spent[3];  // 各会员等级累计消费
+
+// 数据目录（回放模式下切换到独立目录，避免改动正式数据）
+static char data_dir[64] = "data";
+
+// 站点编号：多站点部署时用户/包裹ID = 站点编号 * STATION_ID_SPAN + 站内序号，
+// 保证全网唯一；0为单站点（沿用原ID）
+#define STATION_ID_SPAN 1000000
+#define MAX_STATION_ID 2146 // 保证 (编号+1) * STATION_ID_SPAN 不超出int
+static int station_id = 0;
+
+int station_id_base() {
+    return station_id * STATION_ID_SPAN;
+}
+
+// 拼接数据文件路径
+void data_path(char* path, const char* filename) {
+    sprintf(path, "%s/%s", data_dir, filename);
+}
+
 // 文件操作函数
 void create_data_dir() {
-    system("mkdir data 2>nul"); // 创建数据目录
+#ifdef _WIN32
+    CreateDirectoryA(data_dir, NULL); // 创建数据目录
+#else
+    mkdir(data_dir, 0755);
+#endif
 }
 
 void save_list(const char* filename, void* head, size_t elem_size) {
     char path[100];
-    sprintf(path, "data/%s", filename);
+    data_path(path, filename);
     FILE* fp = fopen(path, "wb");
     if (!fp) return;
 
@@ -106,7 +181,7 @@ void save_list(const char* filename, void* head, size_t elem_size) {
 
 void load_list(const char* filename, void** head, size_t elem_size) {
     char path[100];
-    sprintf(path, "data/%s", filename);
+    data_path(path, filename);
     FILE* fp = fopen(path, "rb");
     if (!fp) return;
 
@@ -136,16 +211,488 @@ void load_list(const char* filename, void** head, size_t elem_size) {
     fclose(fp);
 }
 
+void save_accrual_state();
+void restore_accrued_fees();
+void save_sketches();
+void load_sketches();
+void save_manifest();
+
 void save_all_data() {
     save_list("users.dat", users, sizeof(User));
     save_list("packages.dat", packages, sizeof(Package));
     save_list("finances.dat", finances, sizeof(Finance));
+    save_accrual_state();
+    save_sketches();
+    save_manifest();
+}
+
+// 用临时文件<filename>.tmp替换正式文件
+static void replace_data_file(const char* filename) {
+    char path[100], tmp_path[110];
+    data_path(path, filename);
+    sprintf(tmp_path, "%s.tmp", path);
+    remove(path); // Windows下rename不能覆盖已有文件
+    rename(tmp_path, path);
+}
+
+// 数据格式版本：data/format.dat不存在时视为旧版本1
+// 负数-N表示迁移到版本N的临时文件已全部写好、正在替换正式文件
+int load_format_version() {
+    char path[100];
+    data_path(path, "format.dat");
+    FILE* fp = fopen(path, "rb");
+    if (!fp) {
+        data_path(path, "format.dat.tmp"); // 替换format.dat的过程中中断
+        fp = fopen(path, "rb");
+    }
+    int version = 1;
+    if (fp) {
+        if (fread(&version, sizeof(int), 1, fp) != 1) version = 1;
+        fclose(fp);
+    }
+    return version;
+}
+
+void save_format_version(int version) {
+    char path[100];
+    data_path(path, "format.dat.tmp");
+    FILE* fp = fopen(path, "wb");
+    if (fp) {
+        fwrite(&version, sizeof(int), 1, fp);
+        fclose(fp);
+        replace_data_file("format.dat");
+    }
+}
+
+static const char* migrated_files[] = { "users.dat", "packages.dat", "finances.dat" };
+
+// 完成上次中断的迁移：临时文件已完整，逐个替换（已替换过的不再有临时文件）
+static void finish_migration() {
+    for (int i = 0; i < 3; i++) {
+        char path[100], tmp_path[110];
+        data_path(path, migrated_files[i]);
+        sprintf(tmp_path, "%s.tmp", path);
+        FILE* fp = fopen(tmp_path, "rb");
+        if (!fp) continue;
+        fclose(fp);
+        replace_data_file(migrated_files[i]);
+    }
+}
+
+// 版本1的金额字段是double（元），与money_t同宽，结构体布局不变，原地换算为分
+static money_t legacy_yuan_to_cents(money_t raw) {
+    double yuan;
+    memcpy(&yuan, &raw, sizeof(double));
+    return money_from_yuan(yuan);
+}
+
+void migrate_money_fields() {
+    for (User* u = users; u; u = u->next) {
+        u->total_spent = legacy_yuan_to_cents(u->total_spent);
+    }
+    for (Package* p = packages; p; p = p->next) {
+        p->content_value = legacy_yuan_to_cents(p->content_value);
+        p->storage_fee = legacy_yuan_to_cents(p->storage_fee);
+    }
+    for (Finance* f = finances; f; f = f->next) {
+        f->amount = legacy_yuan_to_cents(f->amount);
+    }
+}
+
+// 版本2及以前的包裹记录布局（无运单号，取件码10字节）
+typedef struct PackageV2 {
+    int id;
+    int user_id;
+    money_t content_value;
+    PackageSize size;
+    PackageWeight weight;
+    SpecialFlags special;
+    ShippingMethod shipping;
+    char shelf_code[10];
+    char pickup_code[10];
+    time_t arrival;
+    time_t pickup;
+    int status;
+    money_t storage_fee;
+    struct Package* next;
+} PackageV2;
+
+// 版本3的包裹记录布局（无超期保管费），与当前布局在storage_fee之前完全一致
+typedef struct PackageV3 {
+    int id;
+    int user_id;
+    money_t content_value;
+    PackageSize size;
+    PackageWeight weight;
+    SpecialFlags special;
+    ShippingMethod shipping;
+    char shelf_code[10];
+    char pickup_code[PICKUP_CODE_SIZE];
+    char tracking_no[24];
+    time_t arrival;
+    time_t pickup;
+    int status;
+    money_t storage_fee;
+    struct Package* next;
+} PackageV3;
+
+// 按旧布局读取包裹文件：版本2运单号留空，超期保管费由restore_accrued_fees按计提进度补齐
+void load_legacy_packages(int version) {
+    char path[100];
+    data_path(path, "packages.dat");
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return;
+
+    Package* tail = NULL;
+    PackageV2 old;
+    PackageV3 old3;
+    while (1) {
+        Package* pkg;
+        if (version == 3) {
+            if (fread(&old3, sizeof(PackageV3), 1, fp) != 1) break;
+            pkg = (Package*)malloc(sizeof(Package));
+            memset(pkg, 0, sizeof(Package));
+            memcpy(pkg, &old3, offsetof(PackageV3, next));
+            if (tail) tail->next = pkg;
+            else packages = pkg;
+            tail = pkg;
+            continue;
+        }
+        if (fread(&old, sizeof(PackageV2), 1, fp) != 1) break;
+        pkg = (Package*)malloc(sizeof(Package));
+        memset(pkg, 0, sizeof(Package));
+        pkg->id = old.id;
+        pkg->user_id = old.user_id;
+        pkg->content_value = old.content_value;
+        pkg->size = old.size;
+        pkg->weight = old.weight;
+        pkg->special = old.special;
+        pkg->shipping = old.shipping;
+        memcpy(pkg->shelf_code, old.shelf_code, sizeof(pkg->shelf_code));
+        memcpy(pkg->pickup_code, old.pickup_code, sizeof(old.pickup_code)); // 旧取件码可能占满10字节，补足结束符
+        pkg->arrival = old.arrival;
+        pkg->pickup = old.pickup;
+        pkg->status = old.status;
+        pkg->storage_fee = old.storage_fee;
+
+        if (tail) tail->next = pkg;
+        else packages = pkg;
+        tail = pkg;
+    }
+    fclose(fp);
 }
 
 void load_all_data() {
+    int version = load_format_version();
+    if (version < 0) {
+        finish_migration();
+        version = -version;
+        save_format_version(version);
+    }
     load_list("users.dat", (void**)&users, sizeof(User));
-    load_list("packages.dat", (void**)&packages, sizeof(Package));
+    if (version < 4) load_legacy_packages(version);
+    else load_list("packages.dat", (void**)&packages, sizeof(Package));
     load_list("finances.dat", (void**)&finances, sizeof(Finance));
+    load_sketches();
+
+    if (version < DATA_FORMAT_VERSION && (users || packages || finances)) {
+        if (version < 2) migrate_money_fields();
+        if (version < 4) restore_accrued_fees();
+        // 立即写回，避免新旧格式混存。先写临时文件并标记迁移中，再替换正式文件：
+        // 任何时刻中断，下次启动要么从原文件重新迁移，要么继续完成替换，不会重复换算
+        save_list("users.dat.tmp", users, sizeof(User));
+        save_list("packages.dat.tmp", packages, sizeof(Package));
+        save_list("finances.dat.tmp", finances, sizeof(Finance));
+        save_format_version(-DATA_FORMAT_VERSION);
+        finish_migration();
+        if (version < 2) printf("数据文件已迁移为整数金额格式\n");
+        if (version < 3) printf("包裹数据已迁移，新增运单号字段\n");
+        if (version < 4) printf("包裹数据已迁移，超期保管费计入包裹费用\n");
+    }
+    save_format_version(DATA_FORMAT_VERSION);
+}
+
+// 时间与线程工具（Windows / POSIX）
+#ifdef _WIN32
+typedef HANDLE thread_handle;
+typedef CRITICAL_SECTION mutex_handle;
+#define mutex_init(m) InitializeCriticalSection(m)
+#define mutex_lock(m) EnterCriticalSection(m)
+#define mutex_unlock(m) LeaveCriticalSection(m)
+#else
+typedef pthread_t thread_handle;
+typedef pthread_mutex_t mutex_handle;
+#define mutex_init(m) pthread_mutex_init(m, NULL)
+#define mutex_lock(m) pthread_mutex_lock(m)
+#define mutex_unlock(m) pthread_mutex_unlock(m)
+#endif
+
+// 数据锁：修改全局链表时必须持有；其他线程读取时通过snapshot_capture在持锁期间复制数据
+static mutex_handle store_mutex;
+
+typedef void (*thread_func)(void* arg);
+
+typedef struct ThreadStart {
+    thread_func fn;
+    void* arg;
+} ThreadStart;
+
+#ifdef _WIN32
+static DWORD WINAPI thread_trampoline(LPVOID param) {
+#else
+static void* thread_trampoline(void* param) {
+#endif
+    ThreadStart start = *(ThreadStart*)param;
+    free(param);
+    start.fn(start.arg);
+    return 0;
+}
+
+int thread_start(thread_handle* thread, thread_func fn, void* arg) {
+    ThreadStart* start = (ThreadStart*)malloc(sizeof(ThreadStart));
+    start->fn = fn;
+    start->arg = arg;
+#ifdef _WIN32
+    *thread = CreateThread(NULL, 0, thread_trampoline, start, 0, NULL);
+    return *thread ? 0 : -1;
+#else
+    return pthread_create(thread, NULL, thread_trampoline, start);
+#endif
+}
+
+void thread_join(thread_handle thread) {
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+// 分离线程，结束后自动回收
+void thread_detach(thread_handle thread) {
+#ifdef _WIN32
+    CloseHandle(thread);
+#else
+    pthread_detach(thread);
+#endif
+}
+
+// 线程安全的localtime
+void local_time(time_t t, struct tm* out) {
+#ifdef _WIN32
+    localtime_s(out, &t);
+#else
+    localtime_r(&t, out);
+#endif
+}
+
+// 微秒时间戳
+long long now_us() {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void sleep_ms(long long ms) {
+#ifdef _WIN32
+    Sleep((DWORD)ms);
+#else
+    struct timespec ts;
+    ts.tv_sec = (time_t)(ms / 1000);
+    ts.tv_nsec = (long)(ms % 1000) * 1000000;
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {} // 被信号打断则睡完剩余时间
+#endif
+}
+
+// 操作轨迹记录
+// 每行格式：<毫秒时间戳> <操作> <参数...>，供回放压测使用
+static FILE* trace_fp = NULL;
+
+void trace_open(const char* filename) {
+    trace_fp = fopen(filename, "a");
+    if (!trace_fp) {
+        printf("无法打开轨迹文件%s\n", filename);
+    }
+}
+
+void trace_record(const char* fmt, ...) {
+    if (!trace_fp) return;
+    fprintf(trace_fp, "%lld ", now_us() / 1000);
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(trace_fp, fmt, args);
+    va_end(args);
+    fputc('\n', trace_fp);
+    fflush(trace_fp); // 异常退出时也保留已记录的轨迹
+}
+
+void trace_close() {
+    if (trace_fp) {
+        fclose(trace_fp);
+        trace_fp = NULL;
+    }
+}
+
+// 包裹事件总线
+// 入库、出库、异常时向环形缓冲区发布事件，供取件通知、货架屏、短信网关等下游订阅。
+// 单生产者：发布方均持有store_mutex；多消费者：每个订阅各自维护读游标，互不影响。
+// 生产者从不等待消费者，缓冲区满时覆盖最旧事件，落后的订阅跳过被覆盖部分并计入dropped。
+// 每个槽位带序号（序号锁），消费者读取前后比对序号，判断是否读到被覆盖的数据。
+#define EVENT_RING_SIZE 1024 // 必须为2的幂
+
+#ifdef _MSC_VER
+typedef volatile LONG64 atomic_seq;
+#define seq_load(p) InterlockedCompareExchange64((p), 0, 0)
+#define seq_store(p, v) InterlockedExchange64((p), (v))
+#define seq_fence() MemoryBarrier()
+#else
+typedef _Atomic long long atomic_seq;
+#define seq_load(p) atomic_load_explicit((p), memory_order_acquire)
+#define seq_store(p, v) atomic_store_explicit((p), (v), memory_order_release)
+#define seq_fence() atomic_thread_fence(memory_order_seq_cst)
+#endif
+
+typedef enum {
+    EVENT_ARRIVED = 1,  // 入库
+    EVENT_PICKED_UP,    // 出库
+    EVENT_EXCEPTION     // 异常
+} PackageEventType;
+
+typedef struct PackageEvent {
+    long long timestamp;
+    int type;
+    int pkg_id;
+    int user_id;
+    int detail;           // 异常类型，其余事件为0
+    char shelf_code[10];
+} PackageEvent;
+
+typedef struct EventSlot {
+    atomic_seq seq;       // 槽内事件的序号，写入中为-1
+    PackageEvent event;
+} EventSlot;
+
+static EventSlot event_ring[EVENT_RING_SIZE];
+static atomic_seq event_head; // 下一个待发布的序号
+
+// 订阅：cursor为下一个要读取的序号
+typedef struct EventSubscription {
+    long long cursor;
+    long long dropped;    // 因落后被覆盖而丢失的事件数
+} EventSubscription;
+
+void event_publish(int type, const Package* pkg, int detail) {
+    long long seq = seq_load(&event_head);
+    EventSlot* slot = &event_ring[seq & (EVENT_RING_SIZE - 1)];
+
+    seq_store(&slot->seq, -1);
+    seq_fence();
+    slot->event.timestamp = (long long)time(NULL);
+    slot->event.type = type;
+    slot->event.pkg_id = pkg->id;
+    slot->event.user_id = pkg->user_id;
+    slot->event.detail = detail;
+    memcpy(slot->event.shelf_code, pkg->shelf_code, sizeof(slot->event.shelf_code));
+    seq_store(&slot->seq, seq);
+    seq_store(&event_head, seq + 1);
+}
+
+// 从当前位置开始订阅（不回放历史事件）
+EventSubscription event_subscribe() {
+    EventSubscription sub;
+    sub.cursor = seq_load(&event_head);
+    sub.dropped = 0;
+    return sub;
+}
+
+// 读取下一条事件，无新事件返回0
+int event_poll(EventSubscription* sub, PackageEvent* out) {
+    while (1) {
+        long long head = seq_load(&event_head);
+        if (sub->cursor >= head) return 0;
+        if (head - sub->cursor > EVENT_RING_SIZE) { // 已被覆盖，跳到最旧的有效事件
+            sub->dropped += head - EVENT_RING_SIZE - sub->cursor;
+            sub->cursor = head - EVENT_RING_SIZE;
+        }
+
+        EventSlot* slot = &event_ring[sub->cursor & (EVENT_RING_SIZE - 1)];
+        long long before = seq_load(&slot->seq);
+        if (before == sub->cursor) {
+            *out = slot->event;
+            seq_fence();
+            if (seq_load(&slot->seq) == before) {
+                sub->cursor++;
+                return 1;
+            }
+        }
+        // 读取期间被覆盖，丢弃该条继续
+        sub->dropped++;
+        sub->cursor++;
+    }
+}
+
+// 本地示例消费者：将事件写入文件，代替通知/短信网关
+typedef struct EventConsumer {
+    FILE* fp;
+    EventSubscription sub;
+} EventConsumer;
+
+static thread_handle event_consumer;
+static EventConsumer event_consumer_state;
+static int event_consumer_running = 0;
+static atomic_seq event_consumer_stop;
+
+static void event_log_consumer(void* arg) {
+    EventConsumer* consumer = (EventConsumer*)arg;
+    const char* names[] = { "", "入库", "出库", "异常" };
+    EventSubscription sub = consumer->sub;
+    long long reported_dropped = 0;
+    FILE* fp = consumer->fp;
+
+    while (1) {
+        int stopping = seq_load(&event_consumer_stop) != 0; // 退出前再读完剩余事件
+        PackageEvent ev;
+        int written = 0;
+        while (event_poll(&sub, &ev)) {
+            fprintf(fp, "%lld %s 包裹%d 用户%d 货架%s %d\n", ev.timestamp, names[ev.type],
+                ev.pkg_id, ev.user_id, ev.shelf_code, ev.detail);
+            written = 1;
+        }
+        if (sub.dropped != reported_dropped) {
+            fprintf(fp, "# 丢失%lld条事件\n", sub.dropped - reported_dropped);
+            reported_dropped = sub.dropped;
+            written = 1;
+        }
+        if (written) fflush(fp);
+        if (stopping) break;
+        if (!written) sleep_ms(10);
+    }
+    fclose(fp);
+}
+
+// 在启动线程前打开文件并订阅，保证启动后发布的事件不会遗漏
+void start_event_consumer(const char* filename) {
+    event_consumer_state.fp = fopen(filename, "a");
+    if (!event_consumer_state.fp) {
+        printf("无法打开事件文件%s，事件消费者未启动\n", filename);
+        return;
+    }
+    event_consumer_state.sub = event_subscribe();
+    seq_store(&event_consumer_stop, 0);
+    if (thread_start(&event_consumer, event_log_consumer, &event_consumer_state) != 0) {
+        printf("无法启动事件消费者线程\n");
+        fclose(event_consumer_state.fp);
+        return;
+    }
+    event_consumer_running = 1;
+}
+
+void stop_event_consumer() {
+    if (!event_consumer_running) return;
+    seq_store(&event_consumer_stop, 1);
+    thread_join(event_consumer);
+    event_consumer_running = 0;
 }
 
 // 函数声明
@@ -153,19 +700,133 @@ void generate_pickup_code(char* code);
 void calculate_pricing(User* user, Package* pkg);
 void add_package();
 void inventory_check();
+void report_new_overdue();
 void package_management();
-void add_user();
+User* add_user();
 void find_user_menu();
 void update_membership();
 void handle_exception(int pkg_id);
 void financial_management();
 void generate_reports();
 Package* find_package(int pkg_id);
+void accrual_track(Package* pkg, int billed_days);
+int accrue_storage_fees(time_t now);
+void init_storage_accrual();
+void print_overdue_list(FILE* out, const Package* overdue, int count, time_t now);
+void free_storage_accrual();
+void user_index_add(Package* pkg);
+void user_index_remove(Package* pkg);
+void init_user_package_index();
+void free_user_package_index();
+void bulk_pickup();
+void sketch_on_inbound(Package* pkg);
+void sketch_on_pickup(Package* pkg);
+void tracking_index_add(Package* pkg);
+void phone_index_add(User* user);
+Package* find_package_by_tracking(const char* tracking_no);
+
+// 账本列存：财务记录挂入链表时同步追加金额、类型和月份到按块分配的数组，
+// 报表直接在数组上分块汇总，无需再逐条遍历链表。
+// 块分配后不再移动、已写入的记录不再修改，快照复制块指针和记录数即可共享。
+#define LEDGER_CHUNK 4096
+
+typedef struct LedgerBlock {
+    money_t amount[LEDGER_CHUNK];
+    int month[LEDGER_CHUNK];           // 年*12+月（本地时间）
+    unsigned char type[LEDGER_CHUNK];  // 1-3，其他类型记为0
+} LedgerBlock;
+
+static LedgerBlock** ledger_blocks = NULL;
+static int ledger_block_capacity = 0;
+static int ledger_count = 0;
+
+// 时间戳所在的本地月份，缓存上次命中的月份区间，同月记录不必再调用localtime
+static int ledger_month_key(time_t t) {
+    static time_t cached_start = 1, cached_end = 0;
+    static int cached_key = 0;
+    if (t >= cached_start && t < cached_end) return cached_key;
+
+    struct tm tm_month;
+    local_time(t, &tm_month);
+    int key = (tm_month.tm_year + 1900) * 12 + tm_month.tm_mon;
+    tm_month.tm_mday = 1;
+    tm_month.tm_hour = tm_month.tm_min = tm_month.tm_sec = 0;
+    tm_month.tm_isdst = -1;
+    cached_start = mktime(&tm_month);
+    tm_month.tm_mon++;
+    tm_month.tm_isdst = -1;
+    cached_end = mktime(&tm_month);
+    cached_key = key;
+    return key;
+}
+
+static void ledger_append(const Finance* f) {
+    int block = ledger_count / LEDGER_CHUNK;
+    int offset = ledger_count % LEDGER_CHUNK;
+    if (offset == 0) {
+        if (block == ledger_block_capacity) {
+            ledger_block_capacity = ledger_block_capacity ? ledger_block_capacity * 2 : 16;
+            ledger_blocks = (LedgerBlock**)realloc(ledger_blocks, ledger_block_capacity * sizeof(LedgerBlock*));
+        }
+        ledger_blocks[block] = (LedgerBlock*)malloc(sizeof(LedgerBlock));
+    }
+    LedgerBlock* b = ledger_blocks[block];
+    b->amount[offset] = f->amount;
+    b->month[offset] = ledger_month_key(f->timestamp);
+    b->type[offset] = (unsigned char)(f->type >= 1 && f->type <= 3 ? f->type : 0);
+    ledger_count++;
+}
+
+// 将head..tail一段新记录挂到财务链表表头，并追加到账本数组（需持有store_mutex）
+void ledger_insert(Finance* head, Finance* tail) {
+    tail->next = finances;
+    finances = head;
+    for (Finance* f = head; f != tail->next; f = f->next) {
+        ledger_append(f);
+    }
+}
+
+// 根据已加载的财务链表建立账本数组
+void init_ledger() {
+    for (Finance* f = finances; f; f = f->next) {
+        ledger_append(f);
+    }
+}
+
+void free_ledger() {
+    int blocks = (ledger_count + LEDGER_CHUNK - 1) / LEDGER_CHUNK;
+    for (int i = 0; i < blocks; i++) free(ledger_blocks[i]);
+    free(ledger_blocks);
+    ledger_blocks = NULL;
+    ledger_block_capacity = ledger_count = 0;
+}
+
+// 数据快照：某一时刻的只读视图，报表在快照上计算，不占用数据锁。
+// 包裹链表只在表头插入、运行期间不释放，快照直接记下表头共享节点，
+// 只读取入库后不再改变的字段（arrival、size）；账本复制块指针和记录数。
+// 会变化的数据（在库数量、会员消费）取持锁时的汇总值，滞留件和客流统计按需复制。
+#define SNAPSHOT_OVERDUE 1  // 复制在库滞留件
+#define SNAPSHOT_TRAFFIC 2  // 复制客流统计所需的概要数据
+
+typedef struct StoreSnapshot {
+    time_t taken_at;
+    const Package* packages;  // 共享的包裹链表
+    LedgerBlock** ledger;     // 账本块指针副本（块本身共享）
+    int ledger_count;         // 快照时刻的财务记录数
+    int stock[5];             // 各尺寸在库数量
+    money_t member_spent[3];  // 各会员等级累计消费
+    Package* overdue;         // 在库滞留件副本
+    int overdue_count;
+    struct StatSketches* sketches;
+} StoreSnapshot;
+
+StoreSnapshot* snapshot_capture(int parts);
+void snapshot_free(StoreSnapshot* snap);
 
 // 生成取件码（示例实现）
 void generate_pickup_code(char* code) {
-    static int counter = 1000;
-    sprintf(code, "PK%d%03d", (int)time(NULL) % 10000, counter++);
+    static unsigned int counter = 1000;
+    snprintf(code, PICKUP_CODE_SIZE, "PK%04u%04u", (unsigned int)(time(NULL) % 10000), counter++ % 10000);
 }
 
 // 价格计算（包含杀熟逻辑和动态调价）
@@ -177,7 +838,7 @@ void generate_pickup_code(char* code) {
 //   2. 根据消费行为实施动态定价（大数据杀熟）
 //   3. 计算特殊处理和运输方式的附加费
 void calculate_pricing(User* user, Package* pkg) {
-    double base = BASE_PRICE;
+    money_t base = BASE_PRICE;
     time_t now = time(NULL);
 
     /* 会员折扣策略：
@@ -185,64 +846,76 @@ void calculate_pricing(User* user, Package* pkg) {
      * 黄金会员永久8折
      * 白银会员无折扣 */
     if (user->membership == 0 && user->purchase_count == 0) { // 新用户首单
-        base *= 0.9;
+        base = money_percent(base, 90);
     }
     else if (user->membership == 2) { // 黄金会员
-        base *= 0.8;
+        base = money_percent(base, 80);
     }
 
     /* 大数据杀熟逻辑：
      * 最近30天消费3次以上 + 15%
      * 总消费超过5000元 + 20%
      * 高频消费（每周超过2次） + 10% */
-    time_t period = now - user->last_purchase;
-    if (user->purchase_count > 5 || user->total_spent > 1000) {
-        base *= 1.2; // 基础加价20%
+    if (user->purchase_count > 5 || user->total_spent > 1000 * 100) {
+        base = money_percent(base, 120); // 基础加价20%
 
         // 动态调价
-        if (user->total_spent > 5000) {
-            base *= 1.2;  // 高消费用户额外加20%
+        if (user->total_spent > 5000 * 100) {
+            base = money_percent(base, 120);  // 高消费用户额外加20%
         }
         if (user->purchase_count / (difftime(now, user->last_purchase) / 86400) > 0.3) { // 日均消费0.3次以上
-            base *= 1.1; // 高频加价10%
+            base = money_percent(base, 110); // 高频加价10%
         }
     }
 
     // 特殊处理附加费
     switch (pkg->special) {
-    case SPECIAL_FRAGILE:      base += 8.0; break;
-    case SPECIAL_UPRIGHT:      base += 5.0; break;
-    case SPECIAL_HAZARDOUS:    base += 15.0; break;
-    case SPECIAL_LIGHT_SENSITIVE: base += 3.0; break;
-    case SPECIAL_REFRIGERATED: base += 10.0; break;
+    case SPECIAL_FRAGILE:      base += 800; break;
+    case SPECIAL_UPRIGHT:      base += 500; break;
+    case SPECIAL_HAZARDOUS:    base += 1500; break;
+    case SPECIAL_LIGHT_SENSITIVE: base += 300; break;
+    case SPECIAL_REFRIGERATED: base += 1000; break;
     default: break;
     }
 
     // 运输方式附加费
     switch (pkg->shipping) {
-    case SHIPPING_EXPRESS_ROAD: base += 5.0; break;
-    case SHIPPING_EXPRESS_AIR:  base += 15.0; break;
-    case SHIPPING_SUPER_EXPRESS: base += 20.0; break;
+    case SHIPPING_EXPRESS_ROAD: base += 500; break;
+    case SHIPPING_EXPRESS_AIR:  base += 1500; break;
+    case SHIPPING_SUPER_EXPRESS: base += 2000; break;
     default: break;
     }
 
-    pkg->storage_fee = round(base * 100) / 100; // 保留两位小数
+    pkg->storage_fee = base;
+}
+
+// 出库时向用户收取的费用：入库时定的存储费用加上已计提的超期保管费
+money_t package_amount_due(const Package* pkg) {
+    return pkg->storage_fee + pkg->accrued_fee;
 }
 // 用户ID管理
 static int user_id = 0;
 static int user_id_initialized = 0;
 
 // 更新会员等级（自动根据消费行为调整）
-void update_membership() {
+// 重新统计各会员等级累计消费（等级变化后调用）
+void recount_member_spent() {
+    memset(member_spent, 0, sizeof(member_spent));
+    for (User* u = users; u; u = u->next) {
+        member_spent[u->membership] += u->total_spent;
+    }
+}
+
+void refresh_membership() {
     User* curr = users;
     time_t now = time(NULL);
 
     while (curr) {
         // 自动升级逻辑
-        if (curr->total_spent > 5000 && difftime(now, curr->last_purchase) < 2592000) {
+        if (curr->total_spent > 5000 * 100 && difftime(now, curr->last_purchase) < 2592000) {
             curr->membership = 2; // 黄金会员
         }
-        else if (curr->total_spent > 1000 && difftime(now, curr->last_purchase) < 2592000) {
+        else if (curr->total_spent > 1000 * 100 && difftime(now, curr->last_purchase) < 2592000) {
             curr->membership = 1; // 白银会员
         }
 
@@ -256,9 +929,27 @@ void update_membership() {
 
         curr = curr->next;
     }
+    recount_member_spent();
+}
+
+void update_membership() {
+    mutex_lock(&store_mutex);
+    refresh_membership();
+    trace_record("membership");
+    mutex_unlock(&store_mutex);
     printf("会员等级已自动更新！\n");
 }
 
+// 按ID查找用户
+User* find_user(int id) {
+    User* curr = users;
+    while (curr) {
+        if (curr->id == id) return curr;
+        curr = curr->next;
+    }
+    return NULL;
+}
+
 // 查找包裹实现
 Package* find_package(int pkg_id) {
     if (pkg_id == 0) {
@@ -283,28 +974,51 @@ Package* find_package(int pkg_id) {
 static int pkg_id = 0;
 static int pkg_id_initialized = 0;
 
+// ID不得进入下一站点的ID段，用尽时保存数据后停止运行，避免全网ID冲突
+// 单站点（编号0）不参与组网，沿用原来不设上限的ID
+static void ensure_id_in_range(int id, const char* kind) {
+    if (station_id == 0) return;
+    int limit = station_id_base() + STATION_ID_SPAN;
+    if (id < limit) return;
+    printf("站点%d的%sID已用尽（上限%d），请为本站分配新的站点编号\n", station_id, kind, limit - 1);
+    save_all_data();
+    exit(1);
+}
+
 void init_package_id() {
     if (!pkg_id_initialized) {
-        FILE* fp = fopen("data/max_ids.dat", "rb");
+        char path[100];
+        data_path(path, "max_ids.dat");
+        FILE* fp = fopen(path, "rb");
+        pkg_id = 1; // 默认起始ID
         if (fp) {
             fseek(fp, sizeof(int), SEEK_SET); // 跳过用户ID
-            fread(&pkg_id, sizeof(int), 1, fp);
+            if (fread(&pkg_id, sizeof(int), 1, fp) != 1) pkg_id = 1;
             fclose(fp);
         }
-        else {
-            pkg_id = 1; // 默认起始ID
+        if (pkg_id < station_id_base()) {
+            pkg_id = station_id_base() + 1; // 切换到站点ID段
         }
         pkg_id_initialized = 1;
     }
 }
 
+void init_user_id();
+
 void save_package_id() {
-    FILE* fp = fopen("data/max_ids.dat", "rb+");
-    if (fp) {
-        fseek(fp, sizeof(int), SEEK_SET); // 定位到包裹ID位置
-        fwrite(&pkg_id, sizeof(int), 1, fp);
-        fclose(fp);
+    char path[100];
+    data_path(path, "max_ids.dat");
+    FILE* fp = fopen(path, "rb+");
+    if (!fp) {
+        // 文件不存在时先写入用户ID，避免用户ID位置留空
+        init_user_id();
+        fp = fopen(path, "wb");
+        if (!fp) return;
+        fwrite(&user_id, sizeof(int), 1, fp);
     }
+    fseek(fp, sizeof(int), SEEK_SET); // 定位到包裹ID位置
+    fwrite(&pkg_id, sizeof(int), 1, fp);
+    fclose(fp);
 }
 
 // 输入验证函数
@@ -324,8 +1038,12 @@ int get_valid_input(const char* prompt, int min, int max) {
     }
 }
 
-void add_package() {
+// 创建包裹并入库（不含交互）
+// tracking_no为承运商运单号，可为NULL或空串；重复运单由调用方事先检查
+Package* create_package(User* target_user, int size, int weight, int special, int shipping, money_t content_value,
+    const char* tracking_no) {
     init_package_id();
+    ensure_id_in_range(pkg_id, "包裹");
 
     Package* new_pkg = (Package*)malloc(sizeof(Package));
     memset(new_pkg, 0, sizeof(Package));
@@ -334,28 +1052,62 @@ void add_package() {
     new_pkg->id = pkg_id++;
     save_package_id();
 
+    new_pkg->size = size;
+    new_pkg->weight = weight;
+    new_pkg->special = special;
+    new_pkg->shipping = shipping;
+    new_pkg->content_value = content_value;
+    if (tracking_no) strncpy(new_pkg->tracking_no, tracking_no, sizeof(new_pkg->tracking_no) - 1);
+    new_pkg->arrival = time(NULL);  // 记录入库时间
+
+    new_pkg->user_id = target_user->id;
+    target_user->total_spent += new_pkg->content_value; // 累计消费金额
+    member_spent[target_user->membership] += new_pkg->content_value;
+    stock_counts[new_pkg->size]++;
+
+    // 生成取件码和货架码
+    generate_pickup_code(new_pkg->pickup_code);
+    sprintf(new_pkg->shelf_code, "SH%02d", rand() % 100);
+
+    // 加入链表
+    new_pkg->next = packages;
+    packages = new_pkg;
+    accrual_track(new_pkg, STORAGE_FREE_DAYS); // 加入保管费计提队列
+    user_index_add(new_pkg);                   // 加入用户包裹索引
+    tracking_index_add(new_pkg);               // 加入运单号索引
+    sketch_on_inbound(new_pkg);                // 更新客流统计
+    event_publish(EVENT_ARRIVED, new_pkg, 0);
+
+    trace_record("inbound %d %d %d %d %d %d %.2f %s", new_pkg->id, new_pkg->user_id,
+        size, weight, special, shipping, MONEY_YUAN(content_value),
+        new_pkg->tracking_no[0] ? new_pkg->tracking_no : "-");
+    return new_pkg;
+}
+
+// 手动录入包裹信息入库，tracking_no为空串表示无运单号
+void add_package_manual(const char* tracking_no) {
     // 获取包裹详细信息（使用输入验证）
-    new_pkg->size = get_valid_input(
+    int size = get_valid_input(
         "包裹尺寸（0-极大 1-大 2-中 3-小 4-极小）: ",
         0, 4);
 
-    new_pkg->weight = get_valid_input(
+    int weight = get_valid_input(
         "包裹重量等级（0-5kg 1-10kg 2-20kg 3-30kg 4-50kg）: ",
         0, 4);
 
-    new_pkg->special = get_valid_input(
+    int special = get_valid_input(
         "特殊标志（0-无 1-易碎 2-不可倒放 3-危险品 4-避光 5-冷藏）: ",
         0, 5);
 
-    new_pkg->shipping = get_valid_input(
+    int shipping = get_valid_input(
         "运输方式（0-标准货车 1-加急公路 2-特快空运 3-特快公路）: ",
         0, 3);
 
     // 输入内容物价值
+    double content_yuan = 0;
     printf("输入包裹内容物价值: ");
-    scanf("%lf", &new_pkg->content_value);
-
-    new_pkg->arrival = time(NULL);  // 记录入库时间
+    scanf("%lf", &content_yuan);
+    money_t content_value = money_from_yuan(content_yuan);
 
     // 用户关联处理
     int user_input_id;
@@ -365,44 +1117,47 @@ void add_package() {
         scanf("%d", &user_input_id);
 
         if (user_input_id == 0) {
-            add_user(); // 转到新建用户模块
-            user_input_id = user_id - 1; // 获取最新创建的用户ID
-            target_user = users; // 新用户位于链表头部
+            target_user = add_user(); // 转到新建用户模块
         }
         else {
-            // 查找用户
-            User* curr = users;
-            while (curr) {
-                if (curr->id == user_input_id) {
-                    target_user = curr;
-                    break;
-                }
-                curr = curr->next;
-            }
+            target_user = find_user(user_input_id);
             if (!target_user) {
                 printf("未找到用户%d，请重新输入或新建用户（输入0）\n", user_input_id);
             }
         }
     } while (!target_user);
 
-    new_pkg->user_id = target_user->id;
-    target_user->total_spent += new_pkg->content_value; // 累计消费金额
-
-    // 生成取件码和货架码
-    generate_pickup_code(new_pkg->pickup_code);
-    sprintf(new_pkg->shelf_code, "SH%02d", rand() % 100);
+    mutex_lock(&store_mutex);
+    Package* new_pkg = NULL;
+    if (!tracking_no[0] || !find_package_by_tracking(tracking_no)) { // 录入期间可能已被扫码入库
+        new_pkg = create_package(target_user, size, weight, special, shipping, content_value, tracking_no);
+    }
+    mutex_unlock(&store_mutex);
+    if (!new_pkg) {
+        printf("运单%s已入库，不能重复登记\n", tracking_no);
+        return;
+    }
+    printf("包裹%d入库成功！取件码：%s\n", new_pkg->id, new_pkg->pickup_code);
+}
 
-    // 加入链表
-    new_pkg->next = packages;
-    packages = new_pkg;
+void scan_one(const char* tracking_no);
 
-    printf("包裹%d入库成功！取件码：%s\n", new_pkg->id, new_pkg->pickup_code);
+void add_package() {
+    char tracking_no[24];
+    printf("输入运单号（无则输入0）: ");
+    scanf("%23s", tracking_no);
+    if (strcmp(tracking_no, "0") == 0) {
+        add_package_manual("");
+    }
+    else {
+        scan_one(tracking_no); // 有运单号时与扫码入库相同：查重、匹配预报
+    }
 }
 
-// 库存盘点
-void inventory_check() {
-    int counts[5] = { 0 };
-    Package* curr = packages;
+// 统计在库包裹各尺寸数量
+void collect_inventory(const Package* head, int counts[5]) {
+    memset(counts, 0, 5 * sizeof(int));
+    const Package* curr = head;
 
     while (curr) {
         if (curr->status == 0) { // 仅统计在库
@@ -410,21 +1165,35 @@ void inventory_check() {
         }
         curr = curr->next;
     }
+}
 
-    printf("\n当前库存：\n");
+// 打印库存占用，capacity为各尺寸货架总容量
+void print_inventory(FILE* out, const int counts[5], int capacity) {
+    fprintf(out, "\n当前库存：\n");
     const char* size_names[] = { "极大", "大", "中", "小", "极小" };
     for (int i = 0; i < 5; i++) {
-        printf("%s: %d件 (%.1f%%)\n",
+        fprintf(out, "%s: %d件 (%.1f%%)\n",
             size_names[i],
             counts[i],
-            (float)counts[i] / SHELF_CAPACITY * 100);
+            (float)counts[i] / capacity * 100);
 
-        if (counts[i] > SHELF_CAPACITY * WARNING_THRESHOLD) {
-            printf("⚠️ 库存预警！%s包裹超过阈值\n", size_names[i]);
+        if (counts[i] > capacity * WARNING_THRESHOLD) {
+            fprintf(out, "⚠️ 库存预警！%s包裹超过阈值\n", size_names[i]);
         }
     }
 }
 
+// 库存盘点
+void inventory_check() {
+    report_new_overdue();
+    StoreSnapshot* snap = snapshot_capture(SNAPSHOT_OVERDUE);
+    trace_record("inventory");
+
+    print_inventory(stdout, snap->stock, SHELF_CAPACITY);
+    print_overdue_list(stdout, snap->overdue, snap->overdue_count, snap->taken_at);
+    snapshot_free(snap);
+}
+
 // 用户管理菜单
 void user_management() {
     int choice;
@@ -450,18 +1219,26 @@ void user_management() {
 // 添加用户
 // 从文件加载最大用户ID
 int load_max_user_id() {
-    FILE* fp = fopen("data/max_ids.dat", "rb");
+    char path[100];
+    data_path(path, "max_ids.dat");
+    FILE* fp = fopen(path, "rb");
     int max_id = 1000;
     if (fp) {
-        fread(&max_id, sizeof(int), 1, fp);
+        if (fread(&max_id, sizeof(int), 1, fp) != 1) max_id = 1000;
         fclose(fp);
     }
+    if (max_id < station_id_base()) {
+        max_id = station_id_base() + 1000; // 切换到站点ID段
+    }
     return max_id;
 }
 
-// 保存最大用户ID
+// 保存最大用户ID（原地覆盖，保留其后的包裹ID）
 void save_max_user_id(int id) {
-    FILE* fp = fopen("data/max_ids.dat", "wb");
+    char path[100];
+    data_path(path, "max_ids.dat");
+    FILE* fp = fopen(path, "rb+");
+    if (!fp) fp = fopen(path, "wb");
     if (fp) {
         fwrite(&id, sizeof(int), 1, fp);
         fclose(fp);
@@ -477,8 +1254,10 @@ void init_user_id() {
     }
 }
 
-void add_user() {
+// 创建用户（不含交互）
+User* create_user(const char* name, const char* phone) {
     init_user_id();  // 确保只初始化一次
+    ensure_id_in_range(user_id, "用户");
 
     User* new_user = (User*)malloc(sizeof(User));
     memset(new_user, 0, sizeof(User));
@@ -487,10 +1266,8 @@ void add_user() {
     new_user->id = user_id++;
     save_max_user_id(user_id);
 
-    printf("输入用户名: ");
-    scanf("%49s", new_user->name);
-    printf("输入联系电话: ");
-    scanf("%19s", new_user->phone);
+    strncpy(new_user->name, name, sizeof(new_user->name) - 1);
+    strncpy(new_user->phone, phone, sizeof(new_user->phone) - 1);
 
     new_user->membership = 0; // 默认新用户
     new_user->last_purchase = time(NULL);
@@ -498,8 +1275,42 @@ void add_user() {
     // 加入链表
     new_user->next = users;
     users = new_user;
+    phone_index_add(new_user); // 加入手机号索引
+
+    trace_record("user %d %s %s", new_user->id, new_user->name, new_user->phone);
+    return new_user;
+}
+
+User* add_user() {
+    char name[50];
+    char phone[20];
+    printf("输入用户名: ");
+    scanf("%49s", name);
+    printf("输入联系电话: ");
+    scanf("%19s", phone);
 
+    mutex_lock(&store_mutex);
+    User* new_user = create_user(name, phone);
+    mutex_unlock(&store_mutex);
     printf("用户添加成功！ID: %d\n", new_user->id);
+    return new_user;
+}
+
+// 标记包裹异常并生成赔偿账单（不含交互）
+void mark_exception(Package* pkg, int type) {
+    if (pkg->status == 0) {
+        user_index_remove(pkg);
+        stock_counts[pkg->size]--;
+    }
+    pkg->status = 2; // 标记为异常
+    Finance* f = (Finance*)malloc(sizeof(Finance));
+    f->type = 3; // 保存费
+    f->amount = pkg->storage_fee * 2; // 双倍赔偿
+    f->timestamp = time(NULL);
+    ledger_insert(f, f);
+
+    event_publish(EVENT_EXCEPTION, pkg, type);
+    trace_record("exception %d %d", pkg->id, type);
 }
 
 // 包裹异常处理
@@ -515,82 +1326,1363 @@ void handle_exception(int pkg_id) {
     int choice;
     scanf("%d", &choice);
 
-    pkg->status = 2; // 标记为异常
-    Finance* f = (Finance*)malloc(sizeof(Finance));
-    f->type = 3; // 保存费
-    f->amount = pkg->storage_fee * 2; // 双倍赔偿
-    f->timestamp = time(NULL);
-    f->next = finances;
-    finances = f;
-
+    mutex_lock(&store_mutex);
+    mark_exception(pkg, choice);
+    mutex_unlock(&store_mutex);
     printf("已记录异常并生成赔偿账单\n");
 }
 
-// 财务统计（增强版）
-void financial_management() {
-    printf("\n=== 财务统计 ===\n");
-    double income[4] = { 0 }; // 0:总 1:计件 2:派送 3:保存
-    double monthly_growth[12] = { 0 }; // 每月增长
-    time_t now = time(NULL);
-    struct tm* tm_now = localtime(&now);
-    int current_year = tm_now->tm_year + 1900;
+// 保管费计提
+// 在库包裹按下一个计费边界（入库时间 + N天）组成小根堆，
+// 每次计提只处理堆顶已到期的包裹，不再遍历整个包裹链表。
+// 已出库/异常的包裹不主动出堆，到期弹出时再丢弃（惰性删除）。
+typedef struct AccrualEntry {
+    time_t due;       // 下一个计费边界
+    int billed_days;  // 已计提到的天数（含免费天数）
+    Package* pkg;
+} AccrualEntry;
+
+// 计提状态持久化记录
+typedef struct AccrualRecord {
+    int pkg_id;
+    int billed_days;
+} AccrualRecord;
+
+static AccrualEntry* accrual_heap = NULL;
+static int accrual_count = 0;
+static int accrual_capacity = 0;
+
+// 滞留件清单
+static Package** overdue_pkgs = NULL;
+static int overdue_count = 0;
+static int overdue_capacity = 0;
+
+static void accrual_push(AccrualEntry entry) {
+    if (accrual_count == accrual_capacity) {
+        accrual_capacity = accrual_capacity ? accrual_capacity * 2 : 64;
+        accrual_heap = (AccrualEntry*)realloc(accrual_heap, accrual_capacity * sizeof(AccrualEntry));
+    }
 
-    // 详细统计
-    Finance* curr = finances;
-    while (curr) {
-        struct tm* tm_record = localtime(&curr->timestamp);
-        if (tm_record->tm_year + 1900 == current_year) {
-            monthly_growth[tm_record->tm_mon] += curr->amount;
-        }
+    // 上浮
+    int i = accrual_count++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (accrual_heap[parent].due <= entry.due) break;
+        accrual_heap[i] = accrual_heap[parent];
+        i = parent;
+    }
+    accrual_heap[i] = entry;
+}
+
+static AccrualEntry accrual_pop() {
+    AccrualEntry top = accrual_heap[0];
+    AccrualEntry last = accrual_heap[--accrual_count];
 
-        income[0] += curr->amount;
-        if (curr->type >= 1 && curr->type <= 3) {
-            income[curr->type] += curr->amount;
+    // 下沉
+    int i = 0;
+    while (1) {
+        int child = i * 2 + 1;
+        if (child >= accrual_count) break;
+        if (child + 1 < accrual_count && accrual_heap[child + 1].due < accrual_heap[child].due) {
+            child++;
         }
-        curr = curr->next;
+        if (last.due <= accrual_heap[child].due) break;
+        accrual_heap[i] = accrual_heap[child];
+        i = child;
     }
+    if (accrual_count > 0) {
+        accrual_heap[i] = last;
+    }
+    return top;
+}
 
-    // 基础统计
-    printf("【基础统计】\n");
-    printf("总收入: ￥%.2f\n", round(income[0] * 100) / 100);
-    printf("├─ 计件费: ￥%.2f\n", round(income[1] * 100) / 100);
-    printf("├─ 派送费: ￥%.2f\n", round(income[2] * 100) / 100);
-    printf("└─ 保存费: ￥%.2f\n", round(income[3] * 100) / 100);
-
-    // 增长趋势
-    printf("\n【月增长趋势】\n");
-    for (int i = 0; i < 12; i++) {
-        printf("%02d月: ￥%-8.2f", i + 1, monthly_growth[i]);
-        if ((i + 1) % 3 == 0) printf("\n");
+static void mark_overdue(Package* pkg) {
+    if (overdue_count == overdue_capacity) {
+        overdue_capacity = overdue_capacity ? overdue_capacity * 2 : 16;
+        overdue_pkgs = (Package**)realloc(overdue_pkgs, overdue_capacity * sizeof(Package*));
     }
+    overdue_pkgs[overdue_count++] = pkg;
+}
 
-    // 分类统计
-    printf("\n【分类统计】\n");
-    printf("会员等级分布:\n");
-    User* u = users;
-    double member_income[3] = { 0 };
-    while (u) {
-        member_income[u->membership] += u->total_spent;
-        u = u->next;
-    }
-    printf("新用户: ￥%.2f\n", member_income[0]);
-    printf("白银会员: ￥%.2f\n", member_income[1]);
-    printf("黄金会员: ￥%.2f\n", member_income[2]);
+// 将在库包裹加入计提队列，billed_days为已计提到的天数
+void accrual_track(Package* pkg, int billed_days) {
+    AccrualEntry entry;
+    entry.pkg = pkg;
+    entry.billed_days = billed_days;
+    entry.due = pkg->arrival + (time_t)(billed_days + 1) * SECONDS_PER_DAY;
+    accrual_push(entry);
+}
 
-    // 图表显示（待定）
+// 移除已出库或异常的滞留件，清单只保留仍在库的包裹
+static void compact_overdue() {
+    int kept = 0;
+    for (int i = 0; i < overdue_count; i++) {
+        if (overdue_pkgs[i]->status == 0) overdue_pkgs[kept++] = overdue_pkgs[i];
+    }
+    overdue_count = kept;
 }
 
+// 计提到期的保管费，并登记新出现的滞留件，返回新增滞留件数
+int accrue_storage_fees(time_t now) {
+    Finance* batch_head = NULL;
+    Finance* batch_tail = NULL;
+    int newly_overdue = 0;
+
+    compact_overdue(); // 随定时计提清理，两次计提之间最多残留一个周期内取走的包裹
+
+    while (accrual_count > 0 && accrual_heap[0].due <= now) {
+        AccrualEntry entry = accrual_pop();
+        Package* pkg = entry.pkg;
+        if (pkg->status != 0) continue; // 已出库或异常，不再计费
+
+        int elapsed = (int)(difftime(now, pkg->arrival) / SECONDS_PER_DAY);
+        int days = elapsed - entry.billed_days;
+        if (days > 0) {
+            Finance* f = (Finance*)malloc(sizeof(Finance));
+            f->type = 3; // 保存费
+            f->amount = (money_t)days * STORAGE_DAILY_FEE;
+            pkg->accrued_fee += f->amount; // 记在包裹上，出库时向用户收取
+            f->timestamp = now;
+            f->next = NULL;
+            if (batch_tail) batch_tail->next = f;
+            else batch_head = f;
+            batch_tail = f;
+        }
 
+        if (entry.billed_days < OVERDUE_DAYS && elapsed >= OVERDUE_DAYS) {
+            mark_overdue(pkg);
+            newly_overdue++;
+        }
 
-// 包裹管理菜单
-void package_management() {
-    int choice;
-    do {
-        printf("\n包裹管理\n");
+        accrual_track(pkg, elapsed > entry.billed_days ? elapsed : entry.billed_days);
+    }
+
+    // 批量挂入财务链表
+    if (batch_head) {
+        ledger_insert(batch_head, batch_tail);
+    }
+    return newly_overdue;
+}
+
+static int compare_accrual_record(const void* a, const void* b) {
+    const AccrualRecord* ra = (const AccrualRecord*)a;
+    const AccrualRecord* rb = (const AccrualRecord*)b;
+    return (ra->pkg_id > rb->pkg_id) - (ra->pkg_id < rb->pkg_id);
+}
+
+// 读取计提进度记录，按包裹ID排序以便二分查找
+static AccrualRecord* load_accrual_records(int* count) {
+    AccrualRecord* records = NULL;
+    int record_count = 0;
+
+    char path[100];
+    data_path(path, "accrual.dat");
+    FILE* fp = fopen(path, "rb");
+    if (fp) {
+        fseek(fp, 0, SEEK_END);
+        long size = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        record_count = (int)(size / sizeof(AccrualRecord));
+        if (record_count > 0) {
+            records = (AccrualRecord*)malloc(record_count * sizeof(AccrualRecord));
+            record_count = (int)fread(records, sizeof(AccrualRecord), record_count, fp);
+            qsort(records, record_count, sizeof(AccrualRecord), compare_accrual_record);
+        }
+        fclose(fp);
+    }
+    *count = record_count;
+    return records;
+}
+
+static AccrualRecord* find_accrual_record(AccrualRecord* records, int count, int pkg_id) {
+    if (!records) return NULL;
+    AccrualRecord key;
+    key.pkg_id = pkg_id;
+    return (AccrualRecord*)bsearch(&key, records, count, sizeof(AccrualRecord), compare_accrual_record);
+}
+
+// 版本4之前计提的保管费只记了账、没有记在包裹上：按已计提天数补齐在库包裹的超期保管费
+void restore_accrued_fees() {
+    int record_count = 0;
+    AccrualRecord* records = load_accrual_records(&record_count);
+    for (Package* curr = packages; curr; curr = curr->next) {
+        if (curr->status != 0) continue;
+        AccrualRecord* found = find_accrual_record(records, record_count, curr->id);
+        if (found && found->billed_days > STORAGE_FREE_DAYS) {
+            curr->accrued_fee = (money_t)(found->billed_days - STORAGE_FREE_DAYS) * STORAGE_DAILY_FEE;
+        }
+    }
+    free(records);
+}
+
+// 根据已加载的包裹和计提记录重建计提队列
+void init_storage_accrual() {
+    int record_count = 0;
+    AccrualRecord* records = load_accrual_records(&record_count);
+
+    Package* curr = packages;
+    while (curr) {
+        if (curr->status == 0) {
+            int billed_days = STORAGE_FREE_DAYS; // 无记录则从免费期结束开始补计
+            AccrualRecord* found = find_accrual_record(records, record_count, curr->id);
+            if (found && found->billed_days > billed_days) {
+                billed_days = found->billed_days;
+            }
+            if (billed_days >= OVERDUE_DAYS) {
+                mark_overdue(curr);
+            }
+            accrual_track(curr, billed_days);
+        }
+        curr = curr->next;
+    }
+    free(records);
+}
+
+// 保存计提进度，避免重启后重复计费
+void save_accrual_state() {
+    char path[100];
+    data_path(path, "accrual.dat");
+    FILE* fp = fopen(path, "wb");
+    if (!fp) return;
+
+    for (int i = 0; i < accrual_count; i++) {
+        if (accrual_heap[i].pkg->status != 0) continue;
+        AccrualRecord record;
+        record.pkg_id = accrual_heap[i].pkg->id;
+        record.billed_days = accrual_heap[i].billed_days;
+        fwrite(&record, sizeof(AccrualRecord), 1, fp);
+    }
+    fclose(fp);
+}
+
+// 打印滞留件清单，overdue为快照中仍在库的滞留件
+void print_overdue_list(FILE* out, const Package* overdue, int count, time_t now) {
+    if (!count) {
+        fprintf(out, "\n暂无滞留件\n");
+        return;
+    }
+    fprintf(out, "\n滞留件清单（超过%d天未取）:\n", OVERDUE_DAYS);
+    for (int i = 0; i < count; i++) {
+        const Package* pkg = &overdue[i];
+        fprintf(out, "包裹%d 用户%d 货架%s 已滞留%.0f天\n",
+            pkg->id, pkg->user_id, pkg->shelf_code,
+            floor(difftime(now, pkg->arrival) / SECONDS_PER_DAY));
+    }
+}
+
+void free_storage_accrual() {
+    free(accrual_heap);
+    accrual_heap = NULL;
+    accrual_count = accrual_capacity = 0;
+    free(overdue_pkgs);
+    overdue_pkgs = NULL;
+    overdue_count = overdue_capacity = 0;
+}
+
+// 计提定时器：后台线程按固定间隔计提，不依赖界面刷新，
+// 停留在子菜单或以--headless运行时同样按时计费、登记滞留件
+static thread_handle accrual_timer;
+static int accrual_timer_running = 0;
+static atomic_seq accrual_timer_stop;
+static int overdue_unreported = 0; // 后台计提新增、尚未提示的滞留件数，受store_mutex保护
+
+static void accrual_timer_run(void* arg) {
+    (void)arg;
+    long long waited = 0;
+    while (!seq_load(&accrual_timer_stop)) {
+        sleep_ms(100); // 分段休眠，退出时不必等满一个间隔
+        waited += 100;
+        if (waited < ACCRUAL_INTERVAL_MS) continue;
+        waited = 0;
+        mutex_lock(&store_mutex);
+        overdue_unreported += accrue_storage_fees(time(NULL));
+        mutex_unlock(&store_mutex);
+    }
+}
+
+void start_accrual_timer() {
+    mutex_lock(&store_mutex);
+    overdue_unreported += accrue_storage_fees(time(NULL)); // 启动时先补计停机期间到期的费用
+    mutex_unlock(&store_mutex);
+    seq_store(&accrual_timer_stop, 0);
+    if (thread_start(&accrual_timer, accrual_timer_run, NULL) == 0) {
+        accrual_timer_running = 1;
+    }
+}
+
+void stop_accrual_timer() {
+    if (!accrual_timer_running) return;
+    seq_store(&accrual_timer_stop, 1);
+    thread_join(accrual_timer);
+    accrual_timer_running = 0;
+}
+
+// 提示后台计提新增的滞留件，由菜单和库存查看在界面线程调用，避免打断正在输入的提示
+void report_new_overdue() {
+    mutex_lock(&store_mutex);
+    int count = overdue_unreported;
+    overdue_unreported = 0;
+    mutex_unlock(&store_mutex);
+    if (count) {
+        printf("⚠️ 新增%d件滞留包裹（超过%d天未取）\n", count, OVERDUE_DAYS);
+    }
+}
+
+// 用户包裹索引
+// 按用户ID哈希分桶，每个用户对应其在库包裹数组，
+// 取件时无需遍历包裹链表和用户链表。
+#define USER_INDEX_BUCKETS 256
+
+typedef struct UserPackageIndex {
+    int user_id;
+    User* user;        // 缓存的用户指针（首次查询时解析）
+    Package** items;   // 该用户的在库包裹
+    int count;
+    int capacity;
+    struct UserPackageIndex* next;
+} UserPackageIndex;
+
+static UserPackageIndex* user_pkg_index[USER_INDEX_BUCKETS];
+
+static UserPackageIndex* user_index_lookup(int user_id, int create) {
+    unsigned int bucket = (unsigned int)user_id % USER_INDEX_BUCKETS;
+    UserPackageIndex* entry = user_pkg_index[bucket];
+    while (entry) {
+        if (entry->user_id == user_id) return entry;
+        entry = entry->next;
+    }
+    if (!create) return NULL;
+
+    entry = (UserPackageIndex*)malloc(sizeof(UserPackageIndex));
+    memset(entry, 0, sizeof(UserPackageIndex));
+    entry->user_id = user_id;
+    entry->next = user_pkg_index[bucket];
+    user_pkg_index[bucket] = entry;
+    return entry;
+}
+
+void user_index_add(Package* pkg) {
+    UserPackageIndex* entry = user_index_lookup(pkg->user_id, 1);
+    if (entry->count == entry->capacity) {
+        entry->capacity = entry->capacity ? entry->capacity * 2 : 4;
+        entry->items = (Package**)realloc(entry->items, entry->capacity * sizeof(Package*));
+    }
+    entry->items[entry->count++] = pkg;
+}
+
+void user_index_remove(Package* pkg) {
+    UserPackageIndex* entry = user_index_lookup(pkg->user_id, 0);
+    if (!entry) return;
+    for (int i = 0; i < entry->count; i++) {
+        if (entry->items[i] == pkg) {
+            entry->items[i] = entry->items[--entry->count]; // 与末尾交换删除
+            return;
+        }
+    }
+}
+
+// 根据已加载的包裹重建索引
+void init_user_package_index() {
+    Package* curr = packages;
+    while (curr) {
+        if (curr->status == 0) {
+            user_index_add(curr);
+        }
+        curr = curr->next;
+    }
+}
+
+void free_user_package_index() {
+    for (int i = 0; i < USER_INDEX_BUCKETS; i++) {
+        while (user_pkg_index[i]) {
+            UserPackageIndex* temp = user_pkg_index[i];
+            user_pkg_index[i] = temp->next;
+            free(temp->items);
+            free(temp);
+        }
+    }
+}
+
+// 解析索引项对应的用户
+static User* user_index_owner(UserPackageIndex* entry) {
+    if (!entry->user) {
+        entry->user = find_user(entry->user_id);
+    }
+    return entry->user;
+}
+
+// 提交批量取件：统一更新状态、财务记录和用户消费记录，返回出库件数
+int bulk_pickup_commit(int target_id) {
+    UserPackageIndex* entry = user_index_lookup(target_id, 0);
+    if (!entry || entry->count == 0 || !user_index_owner(entry)) return 0;
+
+    time_t now = time(NULL);
+    Finance* batch_head = NULL;
+    Finance* batch_tail = NULL;
+    money_t total_fee = 0;
+    int picked = entry->count;
+    for (int i = 0; i < picked; i++) {
+        Package* pkg = entry->items[i];
+        pkg->status = 1;
+        pkg->pickup = now;
+        stock_counts[pkg->size]--;
+        total_fee += package_amount_due(pkg);
+        sketch_on_pickup(pkg);
+        event_publish(EVENT_PICKED_UP, pkg, 0);
+
+        Finance* f = (Finance*)malloc(sizeof(Finance));
+        f->type = 1; // 计件费
+        f->amount = money_percent(pkg->storage_fee, 70); // 70%为计件费
+        f->timestamp = now;
+        f->next = NULL;
+        if (batch_tail) batch_tail->next = f;
+        else batch_head = f;
+        batch_tail = f;
+    }
+    ledger_insert(batch_head, batch_tail);
+    entry->count = 0;
+
+    entry->user->total_spent += total_fee;
+    member_spent[entry->user->membership] += total_fee;
+    entry->user->last_purchase = now;
+    entry->user->purchase_count += picked;
+
+    trace_record("bulk %d %d", target_id, picked);
+    return picked;
+}
+
+// 批量取件：一次性出库某用户的全部在库包裹
+// 先完成身份校验和确认，再统一提交
+void bulk_pickup() {
+    int target_id;
+    printf("输入用户ID: ");
+    if (scanf("%d", &target_id) != 1) {
+        printf("无效的ID输入!\n");
+        while (getchar() != '\n'); // 清空输入缓冲区
+        return;
+    }
+
+    UserPackageIndex* entry = user_index_lookup(target_id, 0);
+    if (!entry || entry->count == 0) {
+        printf("用户%d没有待取包裹\n", target_id);
+        return;
+    }
+    if (!user_index_owner(entry)) {
+        printf("未找到用户%d\n", target_id);
+        return;
+    }
+
+    printf("\n用户%s共有%d件待取包裹:\n", entry->user->name, entry->count);
+    for (int i = 0; i < entry->count; i++) {
+        Package* pkg = entry->items[i];
+        printf("包裹%d 货架%s 费用￥%.2f\n", pkg->id, pkg->shelf_code, MONEY_YUAN(package_amount_due(pkg)));
+    }
+
+    // 身份校验：核对预留电话，并要求出示其中任一包裹的取件码，
+    // 仅知道电话号码不能取走他人的全部包裹
+    char phone[20];
+    printf("输入预留电话验证: ");
+    scanf("%19s", phone);
+    if (strcmp(phone, entry->user->phone) != 0) {
+        printf("电话不匹配，取件取消\n");
+        return;
+    }
+    char code[PICKUP_CODE_SIZE];
+    printf("输入任一包裹的取件码: ");
+    scanf("%11s", code);
+    int code_ok = 0;
+    for (int i = 0; i < entry->count && !code_ok; i++) {
+        code_ok = strcmp(code, entry->items[i]->pickup_code) == 0;
+    }
+    if (!code_ok) {
+        printf("取件码错误，取件取消\n");
+        return;
+    }
+    printf("确认全部出库？(1-确认 0-取消): ");
+    int confirm = 0;
+    scanf("%d", &confirm);
+    if (confirm != 1) {
+        printf("已取消\n");
+        return;
+    }
+
+    mutex_lock(&store_mutex);
+    int picked = bulk_pickup_commit(target_id);
+    mutex_unlock(&store_mutex);
+    printf("用户%d的%d件包裹已全部出库！\n", target_id, picked);
+}
+
+// 运单号索引
+// 运单号 -> 包裹的开放寻址哈希表，前面加一层布隆过滤器：
+// 新运单绝大多数在过滤器处即可判定未入库，只有命中时才查哈希表确认。
+// 运单号一经入库永久占用，出库后重复扫描同样拒绝，因此索引只增不删。
+// 过滤器位数随哈希表容量扩充（每个槽位8位），哈希表负载不超过一半，
+// 即每个运单至少16位，误判率始终在0.1%以下。
+#define BLOOM_BITS_PER_SLOT 8
+#define BLOOM_HASHES 7
+
+static unsigned char* tracking_bloom = NULL;
+static unsigned int tracking_bloom_mask = 0; // 位数-1，位数为2的幂
+static Package** tracking_slots = NULL;
+static int tracking_capacity = 0;
+static int tracking_count = 0;
+
+// 字符串哈希（FNV-1a），运单号、手机号索引共用
+static unsigned long long str_hash(const char* text) {
+    unsigned long long h = 14695981039346656037ULL;
+    for (const unsigned char* c = (const unsigned char*)text; *c; c++) {
+        h ^= *c;
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33; // 打散低位，供取模使用
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// 双重哈希：第i个位置为 h1 + i*h2
+static void bloom_add(unsigned long long h) {
+    unsigned int h1 = (unsigned int)h;
+    unsigned int h2 = (unsigned int)(h >> 32) | 1;
+    for (int i = 0; i < BLOOM_HASHES; i++) {
+        unsigned int bit = (h1 + i * h2) & tracking_bloom_mask;
+        tracking_bloom[bit >> 3] |= (unsigned char)(1 << (bit & 7));
+    }
+}
+
+static int bloom_maybe_contains(unsigned long long h) {
+    unsigned int h1 = (unsigned int)h;
+    unsigned int h2 = (unsigned int)(h >> 32) | 1;
+    for (int i = 0; i < BLOOM_HASHES; i++) {
+        unsigned int bit = (h1 + i * h2) & tracking_bloom_mask;
+        if (!(tracking_bloom[bit >> 3] & (1 << (bit & 7)))) return 0;
+    }
+    return 1;
+}
+
+static void tracking_insert(Package* pkg, unsigned long long h) {
+    unsigned int i = (unsigned int)h & (tracking_capacity - 1);
+    while (tracking_slots[i]) {
+        i = (i + 1) & (tracking_capacity - 1);
+    }
+    tracking_slots[i] = pkg;
+    tracking_count++;
+}
+
+void tracking_index_add(Package* pkg) {
+    if (!pkg->tracking_no[0]) return;
+    if ((tracking_count + 1) * 2 > tracking_capacity) { // 负载超过一半时扩容，过滤器按新容量重建
+        Package** old = tracking_slots;
+        int old_capacity = tracking_capacity;
+        tracking_capacity = tracking_capacity ? tracking_capacity * 2 : 1024;
+        tracking_slots = (Package**)calloc(tracking_capacity, sizeof(Package*));
+        free(tracking_bloom);
+        tracking_bloom = (unsigned char*)calloc((size_t)tracking_capacity * BLOOM_BITS_PER_SLOT / 8, 1);
+        tracking_bloom_mask = (unsigned int)tracking_capacity * BLOOM_BITS_PER_SLOT - 1;
+        tracking_count = 0;
+        for (int i = 0; i < old_capacity; i++) {
+            if (!old[i]) continue;
+            unsigned long long h = str_hash(old[i]->tracking_no);
+            tracking_insert(old[i], h);
+            bloom_add(h);
+        }
+        free(old);
+    }
+    unsigned long long h = str_hash(pkg->tracking_no);
+    tracking_insert(pkg, h);
+    bloom_add(h);
+}
+
+// 按运单号查找包裹，未入库返回NULL
+Package* find_package_by_tracking(const char* tracking_no) {
+    if (!tracking_no[0] || !tracking_count) return NULL;
+    unsigned long long h = str_hash(tracking_no);
+    if (!bloom_maybe_contains(h)) return NULL;
+
+    unsigned int i = (unsigned int)h & (tracking_capacity - 1);
+    while (tracking_slots[i]) {
+        if (strcmp(tracking_slots[i]->tracking_no, tracking_no) == 0) return tracking_slots[i];
+        i = (i + 1) & (tracking_capacity - 1);
+    }
+    return NULL;
+}
+
+// 根据已加载的包裹重建索引
+void init_tracking_index() {
+    for (Package* curr = packages; curr; curr = curr->next) {
+        tracking_index_add(curr);
+    }
+}
+
+void free_tracking_index() {
+    free(tracking_slots);
+    tracking_slots = NULL;
+    tracking_capacity = tracking_count = 0;
+    free(tracking_bloom);
+    tracking_bloom = NULL;
+    tracking_bloom_mask = 0;
+}
+
+// 手机号索引：手机号 -> 用户，预报入库时按手机号匹配收件人。
+// 同号多个用户时保留最新建立的，与按链表顺序查找的结果一致。
+#define PHONE_INDEX_BUCKETS 1024
+
+typedef struct PhoneIndexEntry {
+    User* user;
+    struct PhoneIndexEntry* next;
+} PhoneIndexEntry;
+
+static PhoneIndexEntry* phone_index[PHONE_INDEX_BUCKETS];
+
+void phone_index_add(User* user) {
+    PhoneIndexEntry** link = &phone_index[str_hash(user->phone) % PHONE_INDEX_BUCKETS];
+    for (PhoneIndexEntry* entry = *link; entry; entry = entry->next) {
+        if (strcmp(entry->user->phone, user->phone) == 0) {
+            entry->user = user;
+            return;
+        }
+    }
+    PhoneIndexEntry* entry = (PhoneIndexEntry*)malloc(sizeof(PhoneIndexEntry));
+    entry->user = user;
+    entry->next = *link;
+    *link = entry;
+}
+
+User* find_user_by_phone(const char* phone) {
+    PhoneIndexEntry* entry = phone_index[str_hash(phone) % PHONE_INDEX_BUCKETS];
+    for (; entry; entry = entry->next) {
+        if (strcmp(entry->user->phone, phone) == 0) return entry->user;
+    }
+    return NULL;
+}
+
+// 根据已加载的用户重建索引，链表头为最新用户，因此逆序插入
+void init_phone_index() {
+    int count = 0;
+    for (User* u = users; u; u = u->next) count++;
+    User** order = (User**)malloc((count + 1) * sizeof(User*));
+    int i = 0;
+    for (User* u = users; u; u = u->next) order[i++] = u;
+    while (i > 0) phone_index_add(order[--i]);
+    free(order);
+}
+
+void free_phone_index() {
+    for (int i = 0; i < PHONE_INDEX_BUCKETS; i++) {
+        while (phone_index[i]) {
+            PhoneIndexEntry* temp = phone_index[i];
+            phone_index[i] = temp->next;
+            free(temp);
+        }
+    }
+}
+
+// 承运商预报
+// 到车前导入承运商清单，按运单号预登记；扫码时直接取用预报信息入库。
+// 清单为CSV文本，每行：运单号,收件人,手机号,尺寸,重量,特殊标志,运输方式,内容物价值
+// 以#开头的行和无法解析的行（如表头）跳过。
+// 字段首尾空白去除；运单号、手机号不允许含空白，收件人中的空白替换为下划线，
+// 保证轨迹记录按空格分隔时字段不被拆开。
+#define MANIFEST_BUCKETS 1024
+
+typedef struct ManifestEntry {
+    char tracking_no[24];
+    char name[50];
+    char phone[20];
+    int size;
+    int weight;
+    int special;
+    int shipping;
+    money_t content_value;
+    struct ManifestEntry* next;
+} ManifestEntry;
+
+static ManifestEntry* manifest_table[MANIFEST_BUCKETS];
+static int manifest_count = 0;
+
+// 查找预报，take非零时同时从预报表中取出（由调用方释放）
+static ManifestEntry* manifest_lookup(const char* tracking_no, int take) {
+    ManifestEntry** link = &manifest_table[str_hash(tracking_no) % MANIFEST_BUCKETS];
+    while (*link) {
+        ManifestEntry* entry = *link;
+        if (strcmp(entry->tracking_no, tracking_no) == 0) {
+            if (take) {
+                *link = entry->next;
+                manifest_count--;
+            }
+            return entry;
+        }
+        link = &entry->next;
+    }
+    return NULL;
+}
+
+// 登记一条预报：0成功 1运单已入库 2已在预报中
+int manifest_register(ManifestEntry* entry) {
+    if (find_package_by_tracking(entry->tracking_no)) return 1;
+    if (manifest_lookup(entry->tracking_no, 0)) return 2;
+    unsigned long long bucket = str_hash(entry->tracking_no) % MANIFEST_BUCKETS;
+    entry->next = manifest_table[bucket];
+    manifest_table[bucket] = entry;
+    manifest_count++;
+    return 0;
+}
+
+// 规整字段，allow_space为零时含内部空白返回0
+static int normalize_field(char* field, int allow_space) {
+    char* begin = field;
+    while (*begin == ' ' || *begin == '\t') begin++;
+    size_t len = strlen(begin);
+    while (len > 0 && (begin[len - 1] == ' ' || begin[len - 1] == '\t')) len--;
+    memmove(field, begin, len);
+    field[len] = '\0';
+    if (!len) return 0;
+
+    for (char* c = field; *c; c++) {
+        if (*c != ' ' && *c != '\t') continue;
+        if (!allow_space) return 0;
+        *c = '_';
+    }
+    return 1;
+}
+
+static int parse_manifest_line(const char* line, ManifestEntry* entry) {
+    double yuan;
+    memset(entry, 0, sizeof(ManifestEntry));
+    if (line[0] == '#') return 0;
+    if (sscanf(line, " %23[^,],%49[^,],%19[^,],%d,%d,%d,%d,%lf", entry->tracking_no, entry->name,
+        entry->phone, &entry->size, &entry->weight, &entry->special, &entry->shipping, &yuan) != 8) {
+        return 0;
+    }
+    if (!normalize_field(entry->tracking_no, 0) || !normalize_field(entry->name, 1) ||
+        !normalize_field(entry->phone, 0)) {
+        return 0;
+    }
+    if (entry->size < 0 || entry->size > 4 || entry->weight < 0 || entry->weight > 4 ||
+        entry->special < 0 || entry->special > 5 || entry->shipping < 0 || entry->shipping > 3) {
+        return 0;
+    }
+    entry->content_value = money_from_yuan(yuan);
+    return 1;
+}
+
+// 导入承运商清单。先在锁外解析文件，再持锁批量登记
+void import_manifest() {
+    char filename[100];
+    printf("输入清单文件路径: ");
+    scanf("%99s", filename);
+    FILE* fp = fopen(filename, "r");
+    if (!fp) {
+        printf("无法打开清单文件%s\n", filename);
+        return;
+    }
+
+    ManifestEntry* parsed = NULL;
+    int invalid = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (!line[0]) continue;
+        ManifestEntry* entry = (ManifestEntry*)malloc(sizeof(ManifestEntry));
+        if (!parse_manifest_line(line, entry)) {
+            free(entry);
+            if (line[0] != '#') invalid++;
+            continue;
+        }
+        entry->next = parsed;
+        parsed = entry;
+    }
+    fclose(fp);
+
+    int added = 0, inbound = 0, duplicate = 0;
+    mutex_lock(&store_mutex);
+    while (parsed) {
+        ManifestEntry* entry = parsed;
+        parsed = parsed->next;
+        int result = manifest_register(entry);
+        if (result == 0) {
+            added++;
+            continue;
+        }
+        if (result == 1) inbound++;
+        else duplicate++;
+        free(entry);
+    }
+    mutex_unlock(&store_mutex);
+
+    printf("预报导入完成：新增%d条，已入库%d条，重复%d条，无法解析%d行\n",
+        added, inbound, duplicate, invalid);
+    printf("当前待到件预报%d条\n", manifest_count);
+}
+
+// 按手机号查找用户，找不到则按预报信息新建
+static User* manifest_user(const ManifestEntry* entry) {
+    User* user = find_user_by_phone(entry->phone);
+    return user ? user : create_user(entry->name, entry->phone);
+}
+
+// 扫码入库，调用方需持有store_mutex
+// 返回：0入库成功 1重复扫码（*pkg为已入库包裹） 2不在预报中
+int scan_inbound(const char* tracking_no, Package** pkg) {
+    *pkg = find_package_by_tracking(tracking_no);
+    if (*pkg) return 1;
+
+    ManifestEntry* entry = manifest_lookup(tracking_no, 1);
+    if (!entry) return 2;
+    *pkg = create_package(manifest_user(entry), entry->size, entry->weight, entry->special,
+        entry->shipping, entry->content_value, entry->tracking_no);
+    free(entry);
+    return 0;
+}
+
+// 处理一次扫码，不在预报中的运单转手动录入
+void scan_one(const char* tracking_no) {
+    Package* pkg;
+    mutex_lock(&store_mutex);
+    int result = scan_inbound(tracking_no, &pkg);
+    mutex_unlock(&store_mutex);
+
+    if (result == 0) {
+        printf("包裹%d入库成功！货架：%s 取件码：%s\n", pkg->id, pkg->shelf_code, pkg->pickup_code);
+    }
+    else if (result == 1) {
+        printf("⚠️ 重复扫码：运单%s已入库（包裹%d），已忽略\n", tracking_no, pkg->id);
+    }
+    else {
+        printf("运单%s不在预报中，请手动录入\n", tracking_no);
+        add_package_manual(tracking_no);
+    }
+}
+
+// 连续扫码入库，扫码枪输入运单号后回车，输入0结束
+void scan_ingest() {
+    char tracking_no[24];
+    printf("\n扫码入库（输入0结束），待到件预报%d条\n", manifest_count);
+    while (1) {
+        printf("扫描运单号: ");
+        if (scanf("%23s", tracking_no) != 1 || strcmp(tracking_no, "0") == 0) break;
+        scan_one(tracking_no);
+    }
+}
+
+// 预报持久化，保存待到件的预报记录
+void save_manifest() {
+    char path[100];
+    data_path(path, "manifest.dat");
+    FILE* fp = fopen(path, "wb");
+    if (!fp) return;
+    for (int i = 0; i < MANIFEST_BUCKETS; i++) {
+        for (ManifestEntry* entry = manifest_table[i]; entry; entry = entry->next) {
+            fwrite(entry, sizeof(ManifestEntry), 1, fp);
+        }
+    }
+    fclose(fp);
+}
+
+void load_manifest() {
+    char path[100];
+    data_path(path, "manifest.dat");
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return;
+    ManifestEntry record;
+    while (fread(&record, sizeof(ManifestEntry), 1, fp) == 1) {
+        ManifestEntry* entry = (ManifestEntry*)malloc(sizeof(ManifestEntry));
+        *entry = record;
+        if (manifest_register(entry) != 0) free(entry); // 已入库的预报丢弃
+    }
+    fclose(fp);
+}
+
+void free_manifest() {
+    for (int i = 0; i < MANIFEST_BUCKETS; i++) {
+        while (manifest_table[i]) {
+            ManifestEntry* temp = manifest_table[i];
+            manifest_table[i] = temp->next;
+            free(temp);
+        }
+    }
+    manifest_count = 0;
+}
+
+// 客流统计概要
+// 入库和取件时增量更新固定大小的概要结构，报表直接读取，与历史数据量无关：
+//   每日独立用户数 - HyperLogLog，保留最近HLL_DAYS天
+//   本月包裹最多的用户 - Count-Min计数 + TOP_USERS候选表
+//   入库间隔/滞留时长分位数 - 对数分桶直方图（相对误差约2%）
+#define HLL_PRECISION 10
+#define HLL_REGISTERS (1 << HLL_PRECISION)
+#define HLL_DAYS 31
+#define CM_DEPTH 4
+#define CM_WIDTH 1024
+#define TOP_USERS 10
+#define QUANTILE_BUCKETS 512
+#define QUANTILE_GAMMA 1.04
+
+typedef struct QuantileSketch {
+    unsigned int total;
+    unsigned int zero;                      // 小于1秒的样本
+    unsigned int buckets[QUANTILE_BUCKETS]; // 第k桶覆盖(gamma^(k-1), gamma^k]秒
+} QuantileSketch;
+
+typedef struct TopUser {
+    int user_id;
+    unsigned int count;
+} TopUser;
+
+typedef struct StatSketches {
+    int hll_day[HLL_DAYS];                     // 各槽位对应的日期（天序号）
+    unsigned char hll[HLL_DAYS][HLL_REGISTERS];
+    int cm_month;                              // 计数所属月份（年*12+月）
+    unsigned int cm[CM_DEPTH][CM_WIDTH];
+    TopUser top[TOP_USERS];
+    time_t last_arrival;
+    QuantileSketch arrival_gap;                // 相邻入库间隔
+    QuantileSketch dwell;                      // 入库到取件的滞留时长
+} StatSketches;
+
+static StatSketches sketches;
+
+// 客流统计结果
+typedef struct TrafficStats {
+    double distinct_today;
+    double distinct_week;
+    TopUser top[TOP_USERS];
+    double arrival_gap[3];  // P50 P90 P99（秒）
+    double dwell[3];
+} TrafficStats;
+
+static unsigned long long mix_hash(unsigned long long x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static void hll_add(unsigned char* reg, int user_id) {
+    unsigned long long h = mix_hash((unsigned long long)(unsigned int)user_id);
+    unsigned int index = (unsigned int)(h >> (64 - HLL_PRECISION));
+    unsigned long long rest = h << HLL_PRECISION;
+    unsigned char rank = 1;
+    while (rank <= 64 - HLL_PRECISION && !(rest & (1ULL << 63))) {
+        rank++;
+        rest <<= 1;
+    }
+    if (rank > reg[index]) reg[index] = rank;
+}
+
+static double hll_estimate(const unsigned char* reg) {
+    double sum = 0;
+    int zeros = 0;
+    for (int i = 0; i < HLL_REGISTERS; i++) {
+        sum += ldexp(1.0, -reg[i]);
+        if (reg[i] == 0) zeros++;
+    }
+    double m = HLL_REGISTERS;
+    double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    if (estimate <= 2.5 * m && zeros > 0) {
+        estimate = m * log(m / zeros); // 小基数修正
+    }
+    return estimate;
+}
+
+// 本地日期的天序号（距1970-01-01的天数），与按本地月份清零的计数一致，按本地时间跨天
+static int local_day_number(time_t t) {
+    struct tm tm_local;
+    local_time(t, &tm_local);
+    int y = tm_local.tm_year + 1900;
+    int m = tm_local.tm_mon + 1;
+    int d = tm_local.tm_mday;
+    y -= m <= 2; // 以3月为年首，闰日落在年末
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// 记录当天出现的用户
+static void sketch_touch_user(int user_id, time_t now) {
+    int day = local_day_number(now);
+    int slot = day % HLL_DAYS;
+    if (sketches.hll_day[slot] != day) {
+        sketches.hll_day[slot] = day;
+        memset(sketches.hll[slot], 0, HLL_REGISTERS);
+    }
+    hll_add(sketches.hll[slot], user_id);
+}
+
+// 用户包裹计数加一并维护候选表
+static void sketch_count_user(int user_id, time_t now) {
+    struct tm tm_now;
+    local_time(now, &tm_now);
+    int month = (tm_now.tm_year + 1900) * 12 + tm_now.tm_mon;
+    if (sketches.cm_month != month) { // 跨月清零
+        sketches.cm_month = month;
+        memset(sketches.cm, 0, sizeof(sketches.cm));
+        memset(sketches.top, 0, sizeof(sketches.top));
+    }
+
+    unsigned long long h = mix_hash((unsigned long long)(unsigned int)user_id);
+    unsigned int estimate = 0xFFFFFFFFu;
+    for (int d = 0; d < CM_DEPTH; d++) {
+        unsigned int col = (unsigned int)(h >> (d * 16)) % CM_WIDTH;
+        unsigned int value = ++sketches.cm[d][col];
+        if (value < estimate) estimate = value;
+    }
+
+    int min_slot = 0;
+    for (int i = 0; i < TOP_USERS; i++) {
+        if (sketches.top[i].count && sketches.top[i].user_id == user_id) {
+            sketches.top[i].count = estimate;
+            return;
+        }
+        if (sketches.top[i].count < sketches.top[min_slot].count) min_slot = i;
+    }
+    if (estimate > sketches.top[min_slot].count) {
+        sketches.top[min_slot].user_id = user_id;
+        sketches.top[min_slot].count = estimate;
+    }
+}
+
+static void quantile_add(QuantileSketch* q, double seconds) {
+    q->total++;
+    if (seconds < 1) {
+        q->zero++;
+        return;
+    }
+    int k = (int)ceil(log(seconds) / log(QUANTILE_GAMMA));
+    if (k >= QUANTILE_BUCKETS) k = QUANTILE_BUCKETS - 1;
+    q->buckets[k]++;
+}
+
+static double quantile_query(const QuantileSketch* q, double fraction) {
+    if (q->total == 0) return 0;
+    unsigned int rank = (unsigned int)(fraction * (q->total - 1));
+    if (rank < q->zero) return 0;
+    unsigned int seen = q->zero;
+    for (int k = 0; k < QUANTILE_BUCKETS; k++) {
+        seen += q->buckets[k];
+        if (seen > rank) {
+            return 2 * pow(QUANTILE_GAMMA, k) / (QUANTILE_GAMMA + 1); // 桶中点
+        }
+    }
+    return pow(QUANTILE_GAMMA, QUANTILE_BUCKETS - 1);
+}
+
+void sketch_on_inbound(Package* pkg) {
+    sketch_touch_user(pkg->user_id, pkg->arrival);
+    sketch_count_user(pkg->user_id, pkg->arrival);
+    if (sketches.last_arrival) {
+        quantile_add(&sketches.arrival_gap, difftime(pkg->arrival, sketches.last_arrival));
+    }
+    sketches.last_arrival = pkg->arrival;
+}
+
+void sketch_on_pickup(Package* pkg) {
+    sketch_touch_user(pkg->user_id, pkg->pickup);
+    quantile_add(&sketches.dwell, difftime(pkg->pickup, pkg->arrival));
+}
+
+// 读取客流统计，耗时与数据量无关
+void collect_traffic(const StatSketches* sk, time_t now, TrafficStats* stats) {
+    const double fractions[3] = { 0.5, 0.9, 0.99 };
+    int today = local_day_number(now);
+    unsigned char week[HLL_REGISTERS] = { 0 };
+
+    memset(stats, 0, sizeof(TrafficStats));
+    for (int day = today - 6; day <= today; day++) {
+        int slot = day % HLL_DAYS;
+        if (sk->hll_day[slot] != day) continue;
+        if (day == today) stats->distinct_today = hll_estimate(sk->hll[slot]);
+        for (int i = 0; i < HLL_REGISTERS; i++) { // 并集：逐寄存器取最大值
+            if (sk->hll[slot][i] > week[i]) week[i] = sk->hll[slot][i];
+        }
+    }
+    stats->distinct_week = hll_estimate(week);
+
+    memcpy(stats->top, sk->top, sizeof(stats->top));
+    for (int i = 1; i < TOP_USERS; i++) { // 插入排序，按计数降序
+        TopUser key = stats->top[i];
+        int j = i - 1;
+        while (j >= 0 && stats->top[j].count < key.count) {
+            stats->top[j + 1] = stats->top[j];
+            j--;
+        }
+        stats->top[j + 1] = key;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        stats->arrival_gap[i] = quantile_query(&sk->arrival_gap, fractions[i]);
+        stats->dwell[i] = quantile_query(&sk->dwell, fractions[i]);
+    }
+}
+
+void print_traffic(FILE* out, const TrafficStats* stats) {
+    fprintf(out, "\n客流统计:\n");
+    fprintf(out, "今日独立用户: 约%.0f人\n", stats->distinct_today);
+    fprintf(out, "近7天独立用户: 约%.0f人\n", stats->distinct_week);
+
+    fprintf(out, "\n本月包裹最多的用户:\n");
+    for (int i = 0; i < TOP_USERS && stats->top[i].count; i++) {
+        fprintf(out, "%2d. 用户%d 约%u件\n", i + 1, stats->top[i].user_id, stats->top[i].count);
+    }
+
+    fprintf(out, "\n入库间隔（秒）  P50: %.0f  P90: %.0f  P99: %.0f\n",
+        stats->arrival_gap[0], stats->arrival_gap[1], stats->arrival_gap[2]);
+    fprintf(out, "滞留时长（小时）P50: %.1f  P90: %.1f  P99: %.1f\n",
+        stats->dwell[0] / 3600, stats->dwell[1] / 3600, stats->dwell[2] / 3600);
+}
+
+void save_sketches() {
+    char path[100];
+    data_path(path, "sketches.dat");
+    FILE* fp = fopen(path, "wb");
+    if (!fp) return;
+    fwrite(&sketches, sizeof(StatSketches), 1, fp);
+    fclose(fp);
+}
+
+void load_sketches() {
+    char path[100];
+    data_path(path, "sketches.dat");
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return;
+    if (fread(&sketches, sizeof(StatSketches), 1, fp) != 1) {
+        memset(&sketches, 0, sizeof(StatSketches)); // 文件不完整则重新统计
+    }
+    fclose(fp);
+}
+
+// 数据快照
+// 持锁期间只记录表头和汇总值（O(1)），滞留件与客流概要按需复制，大小与历史数据量无关；
+// 统计和输出都在锁外进行，报表再慢也不会阻塞柜台的入库、取件操作。
+static int snapshots_active = 0; // 未释放的快照数，受store_mutex保护
+
+// 只复制近7天的独立用户计数、候选表和分位数概要，即collect_traffic读取的部分
+static void copy_traffic_sketches(StatSketches* dst, time_t now) {
+    int today = local_day_number(now);
+    for (int slot = 0; slot < HLL_DAYS; slot++) dst->hll_day[slot] = -1;
+    for (int day = today - 6; day <= today; day++) {
+        int slot = day % HLL_DAYS;
+        if (sketches.hll_day[slot] != day) continue;
+        dst->hll_day[slot] = day;
+        memcpy(dst->hll[slot], sketches.hll[slot], HLL_REGISTERS);
+    }
+    memcpy(dst->top, sketches.top, sizeof(dst->top));
+    dst->arrival_gap = sketches.arrival_gap;
+    dst->dwell = sketches.dwell;
+}
+
+// 获取当前时刻的快照，可在任意线程调用；parts为SNAPSHOT_*的组合
+StoreSnapshot* snapshot_capture(int parts) {
+    StoreSnapshot* snap = (StoreSnapshot*)malloc(sizeof(StoreSnapshot));
+    memset(snap, 0, sizeof(StoreSnapshot));
+    if (parts & SNAPSHOT_TRAFFIC) {
+        snap->sketches = (StatSketches*)malloc(sizeof(StatSketches));
+    }
+
+    mutex_lock(&store_mutex);
+    snap->taken_at = time(NULL);
+    snap->packages = packages;
+    int ledger_blocks_used = (ledger_count + LEDGER_CHUNK - 1) / LEDGER_CHUNK;
+    snap->ledger = (LedgerBlock**)malloc((ledger_blocks_used + 1) * sizeof(LedgerBlock*));
+    memcpy(snap->ledger, ledger_blocks, ledger_blocks_used * sizeof(LedgerBlock*));
+    snap->ledger_count = ledger_count;
+    memcpy(snap->stock, stock_counts, sizeof(snap->stock));
+    memcpy(snap->member_spent, member_spent, sizeof(snap->member_spent));
+
+    if (parts & SNAPSHOT_OVERDUE) {
+        snap->overdue = (Package*)malloc((overdue_count + 1) * sizeof(Package));
+        for (int i = 0; i < overdue_count; i++) {
+            if (overdue_pkgs[i]->status != 0) continue; // 已出库或异常
+            snap->overdue[snap->overdue_count] = *overdue_pkgs[i];
+            snap->overdue[snap->overdue_count].next = NULL;
+            snap->overdue_count++;
+        }
+    }
+    if (parts & SNAPSHOT_TRAFFIC) {
+        copy_traffic_sketches(snap->sketches, snap->taken_at);
+    }
+    snapshots_active++;
+    mutex_unlock(&store_mutex);
+    return snap;
+}
+
+void snapshot_free(StoreSnapshot* snap) {
+    if (!snap) return;
+    free(snap->ledger);
+    free(snap->overdue);
+    free(snap->sketches);
+    free(snap);
+
+    mutex_lock(&store_mutex);
+    snapshots_active--;
+    mutex_unlock(&store_mutex);
+}
+
+// 退出前调用：等待所有快照释放（含后台导出），之后一直持有数据锁，
+// 其他线程无法再取快照，可以安全保存并释放链表
+void close_store() {
+    mutex_lock(&store_mutex);
+    while (snapshots_active > 0) {
+        mutex_unlock(&store_mutex);
+        sleep_ms(10);
+        mutex_lock(&store_mutex);
+    }
+}
+
+// 财务统计结果
+typedef struct FinanceStats {
+    money_t income[4];          // 0:总 1:计件 2:派送 3:保存
+    money_t monthly_growth[12]; // 当年每月收入
+    money_t member_income[3];   // 各会员等级累计消费
+} FinanceStats;
+
+// 账本分块汇总
+// 金额为整数，加法满足结合律，各块并行、向量化累加的结果与顺序无关。
+// 未开启OpenMP时按顺序逐块累加。
+typedef struct LedgerPartial {
+    money_t income[4];
+    money_t monthly[13]; // 第13项为非当年记录
+} LedgerPartial;
+
+static void reduce_ledger_chunk(const LedgerBlock* block, int n, int year_key, LedgerPartial* partial) {
+    money_t total = 0, piece = 0, delivery = 0, storage = 0;
+    for (int i = 0; i < n; i++) { // 无分支，便于编译器向量化
+        money_t a = block->amount[i];
+        total += a;
+        piece += a & -(money_t)(block->type[i] == 1);
+        delivery += a & -(money_t)(block->type[i] == 2);
+        storage += a & -(money_t)(block->type[i] == 3);
+    }
+    for (int i = 0; i < n; i++) {
+        unsigned int m = (unsigned int)(block->month[i] - year_key);
+        partial->monthly[m < 12 ? m : 12] += block->amount[i];
+    }
+    partial->income[0] = total;
+    partial->income[1] = piece;
+    partial->income[2] = delivery;
+    partial->income[3] = storage;
+}
+
+// 汇总快照中的财务记录和用户消费
+void collect_finance(const StoreSnapshot* snap, FinanceStats* stats) {
+    memset(stats, 0, sizeof(FinanceStats));
+
+    struct tm tm_now;
+    local_time(snap->taken_at, &tm_now);
+    int year_key = (tm_now.tm_year + 1900) * 12; // 当年1月
+
+    int count = snap->ledger_count;
+    int chunks = (count + LEDGER_CHUNK - 1) / LEDGER_CHUNK;
+    LedgerPartial* partials = (LedgerPartial*)calloc(chunks + 1, sizeof(LedgerPartial));
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (int c = 0; c < chunks; c++) {
+        int begin = c * LEDGER_CHUNK;
+        int n = count - begin < LEDGER_CHUNK ? count - begin : LEDGER_CHUNK;
+        reduce_ledger_chunk(snap->ledger[c], n, year_key, &partials[c]);
+    }
+    for (int c = 0; c < chunks; c++) {
+        for (int k = 0; k < 4; k++) stats->income[k] += partials[c].income[k];
+        for (int m = 0; m < 12; m++) stats->monthly_growth[m] += partials[c].monthly[m];
+    }
+    free(partials);
+
+    memcpy(stats->member_income, snap->member_spent, sizeof(stats->member_income));
+}
+
+// 打印财务统计
+void print_finance(FILE* out, const FinanceStats* stats) {
+    const money_t* income = stats->income;
+    const money_t* monthly_growth = stats->monthly_growth;
+    const money_t* member_income = stats->member_income;
+
+    // 基础统计
+    fprintf(out, "【基础统计】\n");
+    fprintf(out, "总收入: ￥%.2f\n", MONEY_YUAN(income[0]));
+    fprintf(out, "├─ 计件费: ￥%.2f\n", MONEY_YUAN(income[1]));
+    fprintf(out, "├─ 派送费: ￥%.2f\n", MONEY_YUAN(income[2]));
+    fprintf(out, "└─ 保存费: ￥%.2f\n", MONEY_YUAN(income[3]));
+
+    // 增长趋势
+    fprintf(out, "\n【月增长趋势】\n");
+    for (int i = 0; i < 12; i++) {
+        fprintf(out, "%02d月: ￥%-8.2f", i + 1, MONEY_YUAN(monthly_growth[i]));
+        if ((i + 1) % 3 == 0) fprintf(out, "\n");
+    }
+
+    // 分类统计
+    fprintf(out, "\n【分类统计】\n");
+    fprintf(out, "会员等级分布:\n");
+    fprintf(out, "新用户: ￥%.2f\n", MONEY_YUAN(member_income[0]));
+    fprintf(out, "白银会员: ￥%.2f\n", MONEY_YUAN(member_income[1]));
+    fprintf(out, "黄金会员: ￥%.2f\n", MONEY_YUAN(member_income[2]));
+
+    // 图表显示（待定）
+}
+
+// 财务统计（增强版）
+void financial_management() {
+    printf("\n=== 财务统计 ===\n");
+    StoreSnapshot* snap = snapshot_capture(0);
+    FinanceStats stats;
+    collect_finance(snap, &stats);
+    trace_record("finance");
+    print_finance(stdout, &stats);
+    snapshot_free(snap);
+}
+
+
+
+// 包裹出库（不含交互），返回0成功 1不可出库 2取件码错误
+int pickup_package(Package* pkg, const char* code) {
+    if (pkg->status != 0) return 1;
+    if (strcmp(code, pkg->pickup_code) != 0) {
+        trace_record("pickup %d 0", pkg->id);
+        return 2;
+    }
+
+    pkg->status = 1;
+    pkg->pickup = time(NULL);
+    stock_counts[pkg->size]--;
+    user_index_remove(pkg);
+    sketch_on_pickup(pkg);
+    event_publish(EVENT_PICKED_UP, pkg, 0);
+
+    // 记录计件费和派送费
+    Finance* f = (Finance*)malloc(sizeof(Finance));
+    f->type = 1; // 计件费
+    f->amount = money_percent(pkg->storage_fee, 70); // 70%为计件费
+    f->timestamp = time(NULL);
+    ledger_insert(f, f);
+
+    // 更新用户消费记录
+    User* curr_user = find_user(pkg->user_id);
+    if (curr_user) {
+        curr_user->total_spent += package_amount_due(pkg);
+        member_spent[curr_user->membership] += package_amount_due(pkg);
+        curr_user->last_purchase = time(NULL);
+        curr_user->purchase_count++;
+    }
+
+    trace_record("pickup %d 1", pkg->id);
+    return 0;
+}
+
+// 包裹管理菜单
+void package_management() {
+    int choice;
+    do {
+        printf("\n包裹管理\n");
         printf("1. 包裹入库\n");
         printf("2. 包裹出库\n");
         printf("3. 查询包裹\n");
         printf("4. 异常处理\n");
+        printf("5. 批量取件\n");
+        printf("6. 扫码入库\n");
+        printf("7. 导入承运商预报\n");
         printf("0. 返回主菜单\n");
         printf("请选择操作: ");
         scanf("%d", &choice);
@@ -604,33 +2696,14 @@ void package_management() {
             Package* out_pkg = find_package(out_id);
             if (out_pkg && out_pkg->status == 0) {
                 printf("输入取件码: ");
-                char input_code[10];
-                scanf("%9s", input_code);
-
-                if (strcmp(input_code, out_pkg->pickup_code) == 0) {
-                    out_pkg->status = 1;
-                    out_pkg->pickup = time(NULL);
-
-                    // 记录计件费和派送费
-                    Finance* f = (Finance*)malloc(sizeof(Finance));
-                    f->type = 1; // 计件费
-                    f->amount = out_pkg->storage_fee * 0.7; // 70%为计件费
-                    f->timestamp = time(NULL);
-                    f->next = finances;
-                    finances = f;
-
-                    // 更新用户消费记录
-                    User* curr_user = users;
-                    while (curr_user) {
-                        if (curr_user->id == out_pkg->user_id) {
-                            curr_user->total_spent += out_pkg->storage_fee;
-                            curr_user->last_purchase = time(NULL);
-                            curr_user->purchase_count++;
-                            break;
-                        }
-                        curr_user = curr_user->next;
-                    }
-                    printf("包裹%d出库成功！\n", out_id);
+                char input_code[PICKUP_CODE_SIZE];
+                scanf("%11s", input_code);
+
+                mutex_lock(&store_mutex);
+                int result = pickup_package(out_pkg, input_code);
+                mutex_unlock(&store_mutex);
+                if (result == 0) {
+                    printf("包裹%d出库成功！收取费用￥%.2f\n", out_id, MONEY_YUAN(package_amount_due(out_pkg)));
                 }
                 else {
                     printf("取件码错误！\n");
@@ -647,6 +2720,9 @@ void package_management() {
             scanf("%d", &id);
             handle_exception(id);
             break;
+        case 5: bulk_pickup(); break;
+        case 6: scan_ingest(); break;
+        case 7: import_manifest(); break;
         case 0: return;
         default: printf("无效选择!\n");
         }
@@ -739,7 +2815,7 @@ void find_user_menu() {
                         curr->membership == 1 ? "白银会员" : "黄金会员");
                     printf("最近消费: %.2f天前\n",
                         difftime(now, curr->last_purchase) / 86400);
-                    printf("累计消费: ￥%.2f\n", curr->total_spent);
+                    printf("累计消费: ￥%.2f\n", MONEY_YUAN(curr->total_spent));
                     printf("--------------------------------\n");
                 }
                 curr = curr->next;
@@ -755,68 +2831,1065 @@ void find_user_menu() {
 
 // 财务统计
 
+// 计算报表时间范围，choice: 1-日 2-周 3-月，无效选择返回0
+int report_range(int choice, time_t now, time_t* start, time_t* end) {
+    *end = now;
+    if (choice == 1) { // 日报
+        *start = now - 86400;
+    }
+    else if (choice == 2) { // 周报
+        *start = now - 604800;
+    }
+    else if (choice == 3) { // 月报
+        *start = now - 2592000;
+    }
+    else {
+        return 0;
+    }
+    return 1;
+}
+
+// 统计时间段内入库的包裹数量
+void collect_report(const Package* head, time_t start, time_t end, int counts[5]) {
+    memset(counts, 0, 5 * sizeof(int));
+    const Package* pkg = head;
+    while (pkg) {
+        if (pkg->arrival >= start && pkg->arrival <= end) {
+            counts[pkg->size]++;
+        }
+        pkg = pkg->next;
+    }
+}
+
+// 显示时间段统计结果
+void print_report(FILE* out, const int counts[5]) {
+    fprintf(out, "\n时间段统计结果:\n");
+    const char* sizes[] = { "极大", "大", "中", "小", "极小" };
+    for (int i = 0; i < 5; i++) {
+        fprintf(out, "%s包裹数量: %d\n", sizes[i], counts[i]);
+    }
+}
+
 // 生成报表
 void generate_reports() {
-    time_t now = time(NULL);
-    struct tm* tm_now = localtime(&now);
-
     printf("\n报表生成\n");
     printf("1. 日报表\n");
     printf("2. 周报表\n");
     printf("3. 月报表\n");
+    printf("4. 客流统计\n");
     printf("请选择: ");
 
     int choice;
     scanf("%d", &choice);
 
-    // 计算时间范围
+    if (choice < 1 || choice > 4) {
+        printf("无效选择!\n");
+        return;
+    }
+
+    StoreSnapshot* snap = snapshot_capture(choice == 4 ? SNAPSHOT_TRAFFIC : 0);
+    if (choice == 4) {
+        TrafficStats traffic;
+        collect_traffic(snap->sketches, snap->taken_at, &traffic);
+        trace_record("report %d", choice);
+        print_traffic(stdout, &traffic);
+    }
+    else {
+        // 计算时间范围并统计包裹数据
+        time_t start = 0, end = 0;
+        int counts[5];
+        report_range(choice, snap->taken_at, &start, &end);
+        collect_report(snap->packages, start, end, counts);
+        trace_record("report %d", choice);
+        print_report(stdout, counts);
+    }
+    snapshot_free(snap);
+}
+
+// 后台导出报表
+// 在界面线程取快照后交给后台线程写文件，柜台可继续操作。
+
+static void write_reports(FILE* out, const StoreSnapshot* snap) {
+    char stamp[32];
+    struct tm tm_now;
+    local_time(snap->taken_at, &tm_now);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm_now);
+    fprintf(out, "菜鸟驿站报表（数据时间 %s）\n", stamp);
+
+    int counts[5];
+    print_inventory(out, snap->stock, SHELF_CAPACITY);
+    print_overdue_list(out, snap->overdue, snap->overdue_count, snap->taken_at);
+
+    FinanceStats stats;
+    collect_finance(snap, &stats);
+    fprintf(out, "\n=== 财务统计 ===\n");
+    print_finance(out, &stats);
+
+    const char* titles[] = { "日报表", "周报表", "月报表" };
+    for (int choice = 1; choice <= 3; choice++) {
+        time_t start, end;
+        report_range(choice, snap->taken_at, &start, &end);
+        collect_report(snap->packages, start, end, counts);
+        fprintf(out, "\n=== %s ===", titles[choice - 1]);
+        print_report(out, counts);
+    }
+
+    TrafficStats traffic;
+    collect_traffic(snap->sketches, snap->taken_at, &traffic);
+    print_traffic(out, &traffic);
+}
+
+typedef struct ExportJob {
+    StoreSnapshot* snap;
+    char path[100];
+} ExportJob;
+
+static void export_run(void* arg) {
+    ExportJob* job = (ExportJob*)arg;
+    FILE* fp = fopen(job->path, "w");
+    if (fp) {
+        write_reports(fp, job->snap);
+        fclose(fp);
+        printf("\n报表已导出: %s\n", job->path);
+    }
+    else {
+        printf("\n无法写入报表文件%s\n", job->path);
+    }
+    snapshot_free(job->snap);
+    free(job);
+}
+
+void export_reports() {
+    ExportJob* job = (ExportJob*)malloc(sizeof(ExportJob));
+    char filename[32];
+    struct tm tm_now;
+
+    job->snap = snapshot_capture(SNAPSHOT_OVERDUE | SNAPSHOT_TRAFFIC);
+
+    local_time(job->snap->taken_at, &tm_now);
+    strftime(filename, sizeof(filename), "report_%Y%m%d_%H%M%S.txt", &tm_now);
+    data_path(job->path, filename);
+    trace_record("export");
+
+    thread_handle worker;
+    if (thread_start(&worker, export_run, job) != 0) {
+        export_run(job); // 无法创建线程时直接导出
+        return;
+    }
+    thread_detach(worker);
+    printf("正在后台导出报表...\n");
+}
+
+// 释放全部链表及索引
+void free_all_data() {
+    free_storage_accrual();
+    free_user_package_index();
+    free_tracking_index();
+    free_phone_index();
+    free_manifest();
+    memset(stock_counts, 0, sizeof(stock_counts));
+    memset(member_spent, 0, sizeof(member_spent));
+    free_ledger();
+    while (users) {
+        User* temp = users;
+        users = users->next;
+        free(temp);
+    }
+    while (packages) {
+        Package* temp = packages;
+        packages = packages->next;
+        free(temp);
+    }
+    while (finances) {
+        Finance* temp = finances;
+        finances = finances->next;
+        free(temp);
+    }
+}
+
+// 轨迹回放压测
+// 读取trace_record记录的轨迹，按原始时间间隔（可加速）重放到独立数据目录，
+// 可用多个并发客户端同时回放，最后输出吞吐量、延迟分位数和数据校验和。
+// 同一用户的操作固定分配给同一客户端，保证入库先于出库。
+typedef enum {
+    OP_USER,
+    OP_INBOUND,
+    OP_PICKUP,
+    OP_BULK,
+    OP_EXCEPTION,
+    OP_INVENTORY,
+    OP_FINANCE,
+    OP_REPORT,
+    OP_MEMBERSHIP,
+    OP_EXPORT,
+    OP_COUNT
+} TraceOpType;
+
+static const char* trace_op_names[OP_COUNT] = {
+    "user", "inbound", "pickup", "bulk", "exception",
+    "inventory", "finance", "report", "membership", "export"
+};
+
+typedef struct TraceOp {
+    long long t_ms;      // 记录时间（毫秒）
+    int type;
+    int args[6];         // 依操作类型而定，见replay_execute
+    double value;        // 入库内容物价值
+    char name[50];
+    char phone[20];
+    char tracking_no[24]; // 入库运单号，旧轨迹无此字段
+    int client;          // 分配到的回放客户端
+    int skipped;         // 引用的包裹不存在或运单重复而跳过
+    long long latency_us;
+} TraceOp;
+
+// 轨迹ID到回放对象的映射（开放寻址）
+typedef struct IdMap {
+    int* keys;
+    void** values;
+    int capacity;
+    int count;
+} IdMap;
+
+static void* id_map_get(IdMap* map, int key) {
+    if (!map->capacity) return NULL;
+    unsigned int i = (unsigned int)key * 2654435761u & (map->capacity - 1);
+    while (map->values[i]) {
+        if (map->keys[i] == key) return map->values[i];
+        i = (i + 1) & (map->capacity - 1);
+    }
+    return NULL;
+}
+
+static void id_map_put(IdMap* map, int key, void* value) {
+    if ((map->count + 1) * 2 > map->capacity) {
+        IdMap grown;
+        grown.capacity = map->capacity ? map->capacity * 2 : 256;
+        grown.count = 0;
+        grown.keys = (int*)calloc(grown.capacity, sizeof(int));
+        grown.values = (void**)calloc(grown.capacity, sizeof(void*));
+        for (int j = 0; j < map->capacity; j++) {
+            if (map->values[j]) id_map_put(&grown, map->keys[j], map->values[j]);
+        }
+        free(map->keys);
+        free(map->values);
+        *map = grown;
+    }
+
+    unsigned int i = (unsigned int)key * 2654435761u & (map->capacity - 1);
+    while (map->values[i] && map->keys[i] != key) {
+        i = (i + 1) & (map->capacity - 1);
+    }
+    if (!map->values[i]) map->count++;
+    map->keys[i] = key;
+    map->values[i] = value;
+}
+
+static void id_map_free(IdMap* map) {
+    free(map->keys);
+    free(map->values);
+    memset(map, 0, sizeof(IdMap));
+}
+
+#define MAX_REPLAY_CLIENTS 256 // 并发回放客户端上限
+
+typedef struct ReplayClient {
+    TraceOp** ops;       // 分配给该客户端的操作（按时间顺序）
+    int count;
+    int capacity;
+    long long start_us;  // 回放起点
+    long long t0_ms;     // 轨迹起点
+    double speed;        // 回放倍速，0表示最快
+} ReplayClient;
+
+static IdMap replay_users;    // 轨迹用户ID -> User*
+static IdMap replay_packages; // 轨迹包裹ID -> Package*
+
+static int parse_trace_line(const char* line, TraceOp* op) {
+    char name[16];
+    int offset = 0;
+    memset(op, 0, sizeof(TraceOp));
+    if (sscanf(line, "%lld %15s %n", &op->t_ms, name, &offset) < 2) return 0;
+
+    const char* rest = line + offset;
+    for (op->type = 0; op->type < OP_COUNT; op->type++) {
+        if (strcmp(name, trace_op_names[op->type]) == 0) break;
+    }
+
+    switch (op->type) {
+    case OP_USER:
+        return sscanf(rest, "%d %49s %19s", &op->args[0], op->name, op->phone) == 3;
+    case OP_INBOUND:
+        if (sscanf(rest, "%d %d %d %d %d %d %lf %23s", &op->args[0], &op->args[1], &op->args[2],
+            &op->args[3], &op->args[4], &op->args[5], &op->value, op->tracking_no) < 7) {
+            return 0;
+        }
+        if (strcmp(op->tracking_no, "-") == 0) op->tracking_no[0] = '\0';
+        return 1;
+    case OP_PICKUP:
+    case OP_BULK:
+    case OP_EXCEPTION:
+        return sscanf(rest, "%d %d", &op->args[0], &op->args[1]) == 2;
+    case OP_REPORT:
+        return sscanf(rest, "%d", &op->args[0]) == 1;
+    case OP_INVENTORY:
+    case OP_FINANCE:
+    case OP_MEMBERSHIP:
+    case OP_EXPORT:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// 查找轨迹中的用户，回放前不存在的用户（如老用户）自动补建
+static User* replay_user(int trace_id) {
+    User* user = (User*)id_map_get(&replay_users, trace_id);
+    if (!user) {
+        char name[50];
+        sprintf(name, "trace%d", trace_id);
+        user = create_user(name, "0");
+        id_map_put(&replay_users, trace_id, user);
+    }
+    return user;
+}
+
+// 查询类操作基于快照执行，不需要持有数据锁
+static int trace_op_is_query(int type) {
+    return type == OP_INVENTORY || type == OP_FINANCE || type == OP_REPORT || type == OP_EXPORT;
+}
+
+// 执行一条轨迹操作，修改类操作调用方需持有store_mutex
+static void replay_execute(TraceOp* op) {
+    Package* pkg;
+    StoreSnapshot* snap;
+    int counts[5];
+    FinanceStats stats;
+    TrafficStats traffic;
     time_t start, end;
-    if (choice == 1) { // 日报
-        start = now - 86400;
-        end = now;
+    FILE* fp;
+
+    switch (op->type) {
+    case OP_USER:
+        id_map_put(&replay_users, op->args[0], create_user(op->name, op->phone));
+        break;
+    case OP_INBOUND:
+        if (find_package_by_tracking(op->tracking_no)) { op->skipped = 1; break; } // 重复运单
+        pkg = create_package(replay_user(op->args[1]), op->args[2], op->args[3],
+            op->args[4], op->args[5], money_from_yuan(op->value), op->tracking_no);
+        id_map_put(&replay_packages, op->args[0], pkg);
+        break;
+    case OP_PICKUP:
+        pkg = (Package*)id_map_get(&replay_packages, op->args[0]);
+        if (!pkg) { op->skipped = 1; break; }
+        pickup_package(pkg, op->args[1] ? pkg->pickup_code : "BADCODE");
+        break;
+    case OP_BULK:
+        bulk_pickup_commit(replay_user(op->args[0])->id);
+        break;
+    case OP_EXCEPTION:
+        pkg = (Package*)id_map_get(&replay_packages, op->args[0]);
+        if (!pkg) { op->skipped = 1; break; }
+        mark_exception(pkg, op->args[1]);
+        break;
+    case OP_INVENTORY:
+        snap = snapshot_capture(SNAPSHOT_OVERDUE);
+        memcpy(counts, snap->stock, sizeof(counts));
+        snapshot_free(snap);
+        break;
+    case OP_FINANCE:
+        snap = snapshot_capture(0);
+        collect_finance(snap, &stats);
+        snapshot_free(snap);
+        break;
+    case OP_REPORT:
+        snap = snapshot_capture(op->args[0] == 4 ? SNAPSHOT_TRAFFIC : 0);
+        if (op->args[0] == 4) {
+            collect_traffic(snap->sketches, snap->taken_at, &traffic);
+        }
+        else if (report_range(op->args[0], snap->taken_at, &start, &end)) {
+            collect_report(snap->packages, start, end, counts);
+        }
+        snapshot_free(snap);
+        break;
+    case OP_EXPORT:
+        snap = snapshot_capture(SNAPSHOT_OVERDUE | SNAPSHOT_TRAFFIC);
+        fp = tmpfile(); // 回放只衡量导出开销，不保留文件
+        if (fp) {
+            write_reports(fp, snap);
+            fclose(fp);
+        }
+        snapshot_free(snap);
+        break;
+    case OP_MEMBERSHIP:
+        refresh_membership();
+        break;
     }
-    else if (choice == 2) { // 周报
-        start = now - 604800;
-        end = now;
+}
+
+// 等待到指定时刻：先休眠，最后2毫秒忙等以减小误差
+static void wait_until_us(long long target) {
+    long long wait_us = target - now_us();
+    if (wait_us > 2000) sleep_ms(wait_us / 1000 - 1);
+    while (now_us() < target);
+}
+
+static void replay_client_run(void* arg) {
+    ReplayClient* client = (ReplayClient*)arg;
+    wait_until_us(client->start_us); // 所有客户端同时开始
+    for (int i = 0; i < client->count; i++) {
+        TraceOp* op = client->ops[i];
+        long long scheduled = client->start_us;
+        if (client->speed > 0) {
+            scheduled += (long long)((op->t_ms - client->t0_ms) * 1000 / client->speed);
+            wait_until_us(scheduled);
+        }
+
+        long long begin = now_us();
+        if (trace_op_is_query(op->type)) {
+            replay_execute(op);
+        }
+        else {
+            mutex_lock(&store_mutex);
+            replay_execute(op);
+            mutex_unlock(&store_mutex);
+        }
+        long long finish = now_us();
+
+        // 按计划时间计算延迟，回放落后时排队时间也计入
+        op->latency_us = finish - (client->speed > 0 ? scheduled : begin);
     }
-    else if (choice == 3) { // 月报
-        start = now - 2592000;
-        end = now;
+}
+
+static unsigned long long fnv1a(const void* data, size_t len, unsigned long long hash) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
     }
+    return hash;
+}
 
-    // 统计包裹数据
-    int counts[5] = { 0 };
-    Package* pkg = packages;
-    while (pkg) {
-        if (pkg->arrival >= start && pkg->arrival <= end) {
-            counts[pkg->size]++;
+// 计算数据校验和：逐条记录哈希后求和，与并发插入顺序无关
+// 只取回放结果确定的字段（不含ID、时间戳和随机生成的编码）
+static void state_checksums(unsigned long long sums[3]) {
+    const unsigned long long seed = 14695981039346656037ULL;
+    sums[0] = sums[1] = sums[2] = 0;
+
+    for (User* u = users; u; u = u->next) {
+        unsigned long long h = fnv1a(u->name, strlen(u->name), seed);
+        h = fnv1a(u->phone, strlen(u->phone), h);
+        h = fnv1a(&u->purchase_count, sizeof(int), h);
+        h = fnv1a(&u->total_spent, sizeof(money_t), h);
+        sums[0] += h;
+    }
+    for (Package* p = packages; p; p = p->next) {
+        int fields[5] = { p->size, p->weight, p->special, p->shipping, p->status };
+        unsigned long long h = fnv1a(fields, sizeof(fields), seed);
+        h = fnv1a(&p->content_value, sizeof(money_t), h);
+        sums[1] += h;
+    }
+    for (Finance* f = finances; f; f = f->next) {
+        unsigned long long h = fnv1a(&f->type, sizeof(int), seed);
+        h = fnv1a(&f->amount, sizeof(money_t), h);
+        sums[2] += h;
+    }
+}
+
+static int compare_latency(const void* a, const void* b) {
+    long long la = *(const long long*)a;
+    long long lb = *(const long long*)b;
+    return (la > lb) - (la < lb);
+}
+
+static void print_latency_line(const char* label, long long* samples, int n) {
+    if (n == 0) return;
+    qsort(samples, n, sizeof(long long), compare_latency);
+    long long sum = 0;
+    for (int i = 0; i < n; i++) sum += samples[i];
+    printf("%-10s %8d %10.1f %10lld %10lld %10lld %10lld\n", label, n, (double)sum / n,
+        samples[(int)(n * 0.50)], samples[(int)(n * 0.99)],
+        samples[(int)(n * 0.999)], samples[n - 1]);
+}
+
+// 回放入口，speed为倍速（0为最快），clients为并发客户端数
+int run_replay(const char* trace_file, double speed, int clients) {
+    FILE* fp = fopen(trace_file, "r");
+    if (!fp) {
+        printf("无法打开轨迹文件%s\n", trace_file);
+        return 1;
+    }
+
+    TraceOp* ops = NULL;
+    int op_count = 0, op_capacity = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        if (op_count == op_capacity) {
+            op_capacity = op_capacity ? op_capacity * 2 : 1024;
+            ops = (TraceOp*)realloc(ops, op_capacity * sizeof(TraceOp));
         }
-        pkg = pkg->next;
+        if (parse_trace_line(line, &ops[op_count])) op_count++;
+    }
+    fclose(fp);
+    if (op_count == 0) {
+        printf("轨迹为空\n");
+        free(ops);
+        return 1;
     }
 
-    // 显示统计结果
-    printf("\n时间段统计结果:\n");
-    const char* sizes[] = { "极大", "大", "中", "小", "极小" };
-    for (int i = 0; i < 5; i++) {
-        printf("%s包裹数量: %d\n", sizes[i], counts[i]);
+    // 按用户分配客户端：出库/异常通过入库记录找到所属用户
+    if (clients < 1) clients = 1;
+    IdMap owners = { 0 };
+    for (int i = 0; i < op_count; i++) {
+        if (ops[i].type == OP_INBOUND) id_map_put(&owners, ops[i].args[0], &ops[i]);
+    }
+    ReplayClient* pool = (ReplayClient*)calloc(clients, sizeof(ReplayClient));
+    for (int i = 0; i < op_count; i++) {
+        TraceOp* op = &ops[i];
+        int key = i;
+        if (op->type == OP_USER || op->type == OP_BULK) key = op->args[0];
+        else if (op->type == OP_INBOUND) key = op->args[1];
+        else if (op->type == OP_PICKUP || op->type == OP_EXCEPTION) {
+            TraceOp* inbound = (TraceOp*)id_map_get(&owners, op->args[0]);
+            if (inbound) key = inbound->args[1];
+        }
+        op->client = (int)((unsigned int)key % (unsigned int)clients);
+
+        ReplayClient* client = &pool[op->client];
+        if (client->count == client->capacity) {
+            client->capacity = client->capacity ? client->capacity * 2 : 256;
+            client->ops = (TraceOp**)realloc(client->ops, client->capacity * sizeof(TraceOp*));
+        }
+        client->ops[client->count++] = op;
+    }
+    id_map_free(&owners);
+
+    // 使用独立的空数据目录，不影响正式数据
+    strcpy(data_dir, "replay_data");
+    create_data_dir();
+    const char* files[] = { "users.dat", "packages.dat", "finances.dat", "max_ids.dat", "accrual.dat", "sketches.dat",
+        "manifest.dat" };
+    for (int i = 0; i < (int)(sizeof(files) / sizeof(files[0])); i++) {
+        char path[100];
+        data_path(path, files[i]);
+        remove(path);
+    }
+
+    printf("回放%d条操作，%d个客户端，", op_count, clients);
+    if (speed > 0) printf("%.1f倍速\n", speed);
+    else printf("最快速度\n");
+
+    long long start = now_us() + 10000; // 留出线程启动时间
+    thread_handle* threads = (thread_handle*)malloc(clients * sizeof(thread_handle));
+    int* started = (int*)calloc(clients, sizeof(int));
+    for (int i = 0; i < clients; i++) {
+        pool[i].start_us = start;
+        pool[i].t0_ms = ops[0].t_ms;
+        pool[i].speed = speed;
+        started[i] = thread_start(&threads[i], replay_client_run, &pool[i]) == 0;
+    }
+    for (int i = 0; i < clients; i++) {
+        if (!started[i]) {
+            printf("⚠️ 客户端%d的线程创建失败，改为在主线程回放\n", i);
+            replay_client_run(&pool[i]);
+        }
+    }
+    for (int i = 0; i < clients; i++) {
+        if (started[i]) thread_join(threads[i]);
+    }
+    free(started);
+    long long elapsed = now_us() - start;
+    if (elapsed <= 0) elapsed = 1;
+
+    // 汇总结果
+    int skipped = 0;
+    long long* samples = (long long*)malloc(op_count * sizeof(long long));
+    printf("\n耗时: %.3f秒  吞吐量: %.1f次/秒\n", elapsed / 1e6, op_count * 1e6 / elapsed);
+    printf("\n%-10s %8s %10s %10s %10s %10s %10s  (微秒)\n",
+        "操作", "次数", "平均", "P50", "P99", "P99.9", "最大");
+    for (int type = 0; type < OP_COUNT; type++) {
+        int n = 0;
+        for (int i = 0; i < op_count; i++) {
+            if (ops[i].type == type) samples[n++] = ops[i].latency_us;
+        }
+        print_latency_line(trace_op_names[type], samples, n);
+    }
+    for (int i = 0; i < op_count; i++) {
+        samples[i] = ops[i].latency_us;
+        skipped += ops[i].skipped;
+    }
+    print_latency_line("all", samples, op_count);
+    if (skipped) printf("跳过%d条引用了未知包裹或运单重复的操作\n", skipped);
+
+    unsigned long long sums[3];
+    state_checksums(sums);
+    int counts[3] = { 0 };
+    for (User* u = users; u; u = u->next) counts[0]++;
+    for (Package* p = packages; p; p = p->next) counts[1]++;
+    for (Finance* f = finances; f; f = f->next) counts[2]++;
+    printf("\n最终状态校验和:\n");
+    printf("用户 %6d条 %016llx\n", counts[0], sums[0]);
+    printf("包裹 %6d条 %016llx\n", counts[1], sums[1]);
+    printf("财务 %6d条 %016llx\n", counts[2], sums[2]);
+
+    free(samples);
+    free(threads);
+    for (int i = 0; i < clients; i++) free(pool[i].ops);
+    free(pool);
+    free(ops);
+    id_map_free(&replay_users);
+    id_map_free(&replay_packages);
+    free_all_data();
+    return 0;
+}
+
+// 多站点汇总
+// 站点进程以 --serve <端口> 在本机监听查询（每个连接一行请求、一行应答），
+// 路由进程以 --router <端口,端口,...> 并发查询各站点并合并部分汇总结果。
+//   请求：INVENTORY | FINANCE | REPORT <1-3>
+//   应答：<站点编号> <整数...>，出错时为 ERR
+#ifdef _WIN32
+typedef SOCKET socket_handle;
+#define close_socket closesocket
+#else
+typedef int socket_handle;
+#define INVALID_SOCKET (-1)
+#define close_socket close
+#endif
+
+#define MAX_STATIONS 64
+#define NET_LINE_SIZE 1024
+#define NET_TIMEOUT_MS 2000  // 连接、收发超时，防止无响应的对端卡住服务或路由
+
+void net_init() {
+#ifdef _WIN32
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+}
+
+// 设置收发超时，超时后recv/send返回错误
+static void set_socket_timeout(socket_handle sock, int ms) {
+#ifdef _WIN32
+    DWORD timeout = (DWORD)ms;
+#else
+    struct timeval timeout;
+    timeout.tv_sec = ms / 1000;
+    timeout.tv_usec = (ms % 1000) * 1000;
+#endif
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout));
+}
+
+static void set_socket_blocking(socket_handle sock, int blocking) {
+#ifdef _WIN32
+    u_long mode = blocking ? 0 : 1;
+    ioctlsocket(sock, FIONBIO, &mode);
+#else
+    int flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK));
+#endif
+}
+
+// 非阻塞连接，超时或失败返回-1
+static int connect_timeout(socket_handle sock, const struct sockaddr_in* addr, int ms) {
+    set_socket_blocking(sock, 0);
+    int result = connect(sock, (const struct sockaddr*)addr, sizeof(*addr));
+    if (result != 0) {
+#ifdef _WIN32
+        int pending = WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        int pending = errno == EINPROGRESS;
+#endif
+        if (pending) {
+            fd_set writable;
+            FD_ZERO(&writable);
+            FD_SET(sock, &writable);
+            struct timeval timeout;
+            timeout.tv_sec = ms / 1000;
+            timeout.tv_usec = (ms % 1000) * 1000;
+            if (select((int)sock + 1, NULL, &writable, NULL, &timeout) == 1) {
+                int error = 0;
+                socklen_t len = sizeof(error);
+                getsockopt(sock, SOL_SOCKET, SO_ERROR, (char*)&error, &len);
+                if (error == 0) result = 0;
+            }
+        }
+    }
+    set_socket_blocking(sock, 1);
+    return result == 0 ? 0 : -1;
+}
+
+static int send_all(socket_handle sock, const char* buf, int len) {
+    while (len > 0) {
+        int sent = send(sock, buf, len, 0);
+        if (sent <= 0) return -1;
+        buf += sent;
+        len -= sent;
+    }
+    return 0;
+}
+
+// 读取一行（不含换行符），连接关闭或出错返回-1
+static int recv_line(socket_handle sock, char* buf, int size) {
+    int len = 0;
+    while (len < size - 1) {
+        char c;
+        if (recv(sock, &c, 1, 0) != 1) {
+            if (len == 0) return -1;
+            break;
+        }
+        if (c == '\n') break;
+        if (c != '\r') buf[len++] = c;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+static struct sockaddr_in local_address(int port) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return addr;
+}
+
+// 基于数据快照计算查询结果
+static void station_answer(const char* request, char* reply) {
+    int n = sprintf(reply, "%d", station_id);
+    int choice = 0;
+
+    if (strcmp(request, "INVENTORY") == 0) {
+        StoreSnapshot* snap = snapshot_capture(SNAPSHOT_OVERDUE);
+        int counts[5];
+        memcpy(counts, snap->stock, sizeof(counts));
+        int overdue = snap->overdue_count;
+        snapshot_free(snap);
+        for (int i = 0; i < 5; i++) n += sprintf(reply + n, " %d", counts[i]);
+        n += sprintf(reply + n, " %d", overdue);
+    }
+    else if (strcmp(request, "FINANCE") == 0) {
+        FinanceStats stats;
+        StoreSnapshot* snap = snapshot_capture(0);
+        collect_finance(snap, &stats);
+        snapshot_free(snap);
+        for (int i = 0; i < 4; i++) n += sprintf(reply + n, " %lld", (long long)stats.income[i]);
+        for (int i = 0; i < 12; i++) n += sprintf(reply + n, " %lld", (long long)stats.monthly_growth[i]);
+        for (int i = 0; i < 3; i++) n += sprintf(reply + n, " %lld", (long long)stats.member_income[i]);
+    }
+    else if (sscanf(request, "REPORT %d", &choice) == 1) {
+        time_t start, end;
+        int counts[5];
+        StoreSnapshot* snap = snapshot_capture(0);
+        if (!report_range(choice, snap->taken_at, &start, &end)) {
+            snapshot_free(snap);
+            strcpy(reply, "ERR");
+            return;
+        }
+        collect_report(snap->packages, start, end, counts);
+        snapshot_free(snap);
+        for (int i = 0; i < 5; i++) n += sprintf(reply + n, " %d", counts[i]);
+    }
+    else {
+        strcpy(reply, "ERR");
+    }
+}
+
+// 站点查询服务，逐个处理连接
+static void station_serve(void* arg) {
+    int port = *(int*)arg;
+    socket_handle listener = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+    struct sockaddr_in addr = local_address(port);
+    if (listener == INVALID_SOCKET
+        || bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0
+        || listen(listener, 16) != 0) {
+        printf("站点服务启动失败，端口%d\n", port);
+        return;
+    }
+
+    while (1) {
+        socket_handle client = accept(listener, NULL, NULL);
+        if (client == INVALID_SOCKET) continue;
+        set_socket_timeout(client, NET_TIMEOUT_MS); // 连上不发请求的客户端不会卡住服务
+
+        char request[NET_LINE_SIZE];
+        char reply[NET_LINE_SIZE];
+        if (recv_line(client, request, sizeof(request)) >= 0) {
+            station_answer(request, reply);
+            strcat(reply, "\n");
+            send_all(client, reply, (int)strlen(reply));
+        }
+        close_socket(client);
+    }
+}
+
+typedef struct StationQuery {
+    int port;
+    const char* request;
+    char reply[NET_LINE_SIZE];
+    long long values[32];  // 应答中的整数，values[0]为站点编号
+    int count;             // 0表示站点无响应或出错
+} StationQuery;
+
+static void station_query_run(void* arg) {
+    StationQuery* query = (StationQuery*)arg;
+    query->count = 0;
+
+    socket_handle sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock == INVALID_SOCKET) return;
+    struct sockaddr_in addr = local_address(query->port);
+    char line[NET_LINE_SIZE];
+    sprintf(line, "%s\n", query->request);
+    set_socket_timeout(sock, NET_TIMEOUT_MS);
+    if (connect_timeout(sock, &addr, NET_TIMEOUT_MS) == 0
+        && send_all(sock, line, (int)strlen(line)) == 0
+        && recv_line(sock, query->reply, sizeof(query->reply)) > 0
+        && strncmp(query->reply, "ERR", 3) != 0) {
+        char* p = query->reply;
+        char* end;
+        while (query->count < 32) {
+            long long value = strtoll(p, &end, 10);
+            if (end == p) break;
+            query->values[query->count++] = value;
+            p = end;
+        }
     }
+    close_socket(sock);
+}
+
+// 并发向所有站点发送同一请求，返回有效应答数
+static int router_fan_out(const int* ports, int station_count, const char* request, StationQuery* queries) {
+    thread_handle threads[MAX_STATIONS];
+    int started[MAX_STATIONS];
+    for (int i = 0; i < station_count; i++) {
+        queries[i].port = ports[i];
+        queries[i].request = request;
+        started[i] = thread_start(&threads[i], station_query_run, &queries[i]) == 0;
+        if (!started[i]) station_query_run(&queries[i]); // 无法创建线程时直接查询
+    }
+
+    int answered = 0;
+    for (int i = 0; i < station_count; i++) {
+        if (started[i]) thread_join(threads[i]);
+        if (queries[i].count > 0) answered++;
+        else printf("⚠️ 端口%d的站点无响应，结果不含该站点\n", ports[i]);
+    }
+    return answered;
+}
+
+// 路由菜单：汇总全网库存、财务和报表
+void router_menu(const int* ports, int station_count) {
+    StationQuery queries[MAX_STATIONS];
+    int choice;
+    do {
+        printf("\n全网汇总（%d个站点）\n", station_count);
+        printf("1. 库存汇总\n");
+        printf("2. 财务汇总\n");
+        printf("3. 报表汇总\n");
+        printf("0. 退出\n");
+        printf("请选择操作: ");
+        if (scanf("%d", &choice) != 1) return;
+
+        switch (choice) {
+        case 1: {
+            int answered = router_fan_out(ports, station_count, "INVENTORY", queries);
+            int counts[5] = { 0 };
+            int overdue = 0;
+            for (int i = 0; i < station_count; i++) {
+                if (queries[i].count < 7) continue;
+                int total = 0;
+                for (int k = 0; k < 5; k++) {
+                    counts[k] += (int)queries[i].values[1 + k];
+                    total += (int)queries[i].values[1 + k];
+                }
+                overdue += (int)queries[i].values[6];
+                printf("站点%lld: 在库%d件 滞留%lld件\n", queries[i].values[0], total, queries[i].values[6]);
+            }
+            if (answered) {
+                print_inventory(stdout, counts, SHELF_CAPACITY * answered);
+                printf("全网滞留件: %d件\n", overdue);
+            }
+            break;
+        }
+        case 2: {
+            int answered = router_fan_out(ports, station_count, "FINANCE", queries);
+            FinanceStats stats;
+            memset(&stats, 0, sizeof(stats));
+            for (int i = 0; i < station_count; i++) {
+                if (queries[i].count < 20) continue;
+                const long long* v = queries[i].values + 1;
+                for (int k = 0; k < 4; k++) stats.income[k] += v[k];
+                for (int k = 0; k < 12; k++) stats.monthly_growth[k] += v[4 + k];
+                for (int k = 0; k < 3; k++) stats.member_income[k] += v[16 + k];
+                printf("站点%lld: 总收入￥%.2f\n", queries[i].values[0], MONEY_YUAN(v[0]));
+            }
+            if (answered) {
+                printf("\n=== 全网财务统计 ===\n");
+                print_finance(stdout, &stats);
+            }
+            break;
+        }
+        case 3: {
+            int range = get_valid_input("1. 日报表\n2. 周报表\n3. 月报表\n请选择: ", 1, 3);
+            char request[32];
+            sprintf(request, "REPORT %d", range);
+            int answered = router_fan_out(ports, station_count, request, queries);
+            int counts[5] = { 0 };
+            for (int i = 0; i < station_count; i++) {
+                if (queries[i].count < 6) continue;
+                for (int k = 0; k < 5; k++) counts[k] += (int)queries[i].values[1 + k];
+            }
+            if (answered) print_report(stdout, counts);
+            break;
+        }
+        case 0: return;
+        default: printf("无效选择!\n");
+        }
+    } while (1);
 }
 
 // 主菜单实现
-int main() {
-    system("chcp 65001"); // 设置控制台编码为UTF-8,避免不使用visual studio时中文乱码
+// 命令行参数：
+//   --trace <文件>    记录操作轨迹
+//   --replay <文件>   回放轨迹压测，配合 --speed <倍速|max> 和 --clients <并发数>
+//   --station <编号>  多站点部署的站点编号，默认数据目录为data_s<编号>
+//   --data <目录>     指定数据目录
+//   --serve <端口>    在本机端口提供汇总查询，加 --headless 则只提供查询不进入菜单
+//   --router <端口,...> 作为路由汇总各站点
+//   --events <文件>   启动示例事件消费者，将包裹事件写入文件
+int main(int argc, char* argv[]) {
+    const char* trace_file = NULL;
+    const char* replay_file = NULL;
+    const char* data_arg = NULL;
+    const char* router_arg = NULL;
+    const char* events_file = NULL;
+    double replay_speed = 1.0;
+    int replay_clients = 1;
+    int serve_port = 0;
+    int headless = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "max") == 0) {
+                replay_speed = 0;
+            }
+            else {
+                char* end;
+                replay_speed = strtod(argv[i], &end);
+                if (*end != '\0' || end == argv[i] || !(replay_speed > 0) || isinf(replay_speed)) {
+                    printf("回放倍速必须是正数或max\n");
+                    return 1;
+                }
+            }
+        }
+        else if (strcmp(argv[i], "--clients") == 0 && i + 1 < argc) {
+            char* end;
+            long value = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || end == argv[i] || value < 1 || value > MAX_REPLAY_CLIENTS) {
+                printf("回放客户端数必须是1到%d之间的整数\n", MAX_REPLAY_CLIENTS);
+                return 1;
+            }
+            replay_clients = (int)value;
+        }
+        else if (strcmp(argv[i], "--station") == 0 && i + 1 < argc) {
+            char* end;
+            long value = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || end == argv[i] || value < 1 || value > MAX_STATION_ID) {
+                printf("站点编号必须是1到%d之间的整数\n", MAX_STATION_ID);
+                return 1;
+            }
+            station_id = (int)value;
+        }
+        else if (strcmp(argv[i], "--data") == 0 && i + 1 < argc) {
+            data_arg = argv[++i];
+        }
+        else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serve_port = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--headless") == 0) {
+            headless = 1;
+        }
+        else if (strcmp(argv[i], "--router") == 0 && i + 1 < argc) {
+            router_arg = argv[++i];
+        }
+        else if (strcmp(argv[i], "--events") == 0 && i + 1 < argc) {
+            events_file = argv[++i];
+        }
+    }
+
+    mutex_init(&store_mutex);
     srand(time(NULL)); // 初始化随机数
+    if (replay_file) {
+        return run_replay(replay_file, replay_speed, replay_clients);
+    }
+
+    system("chcp 65001"); // 设置控制台编码为UTF-8,避免不使用visual studio时中文乱码
+    if (router_arg) {
+        int ports[MAX_STATIONS];
+        int station_count = 0;
+        const char* p = router_arg;
+        while (*p && station_count < MAX_STATIONS) {
+            ports[station_count++] = atoi(p);
+            while (*p && *p != ',') p++;
+            if (*p == ',') p++;
+        }
+        net_init();
+        router_menu(ports, station_count);
+        return 0;
+    }
+
+    if (data_arg) {
+        snprintf(data_dir, sizeof(data_dir), "%s", data_arg);
+    }
+    else if (station_id > 0) {
+        sprintf(data_dir, "data_s%d", station_id);
+    }
     create_data_dir(); // 创建数据目录
     load_all_data();   // 加载已有数据
+    init_storage_accrual(); // 重建保管费计提队列
+    init_user_package_index(); // 重建用户包裹索引
+    collect_inventory(packages, stock_counts); // 初始化在库数量汇总
+    recount_member_spent();    // 初始化会员消费汇总
+    init_ledger();             // 建立账本数组
+    init_tracking_index();     // 重建运单号索引
+    init_phone_index();        // 重建手机号索引
+    load_manifest();           // 加载待到件预报
+    if (trace_file) trace_open(trace_file);
+    if (events_file) start_event_consumer(events_file);
+    start_accrual_timer(); // 定时计提保管费
+
+    if (serve_port) {
+        net_init();
+        if (headless) {
+            printf("站点%d查询服务运行于端口%d\n", station_id, serve_port);
+            station_serve(&serve_port);
+            return 0;
+        }
+        thread_handle server;
+        if (thread_start(&server, station_serve, &serve_port) != 0) {
+            printf("⚠️ 查询服务线程创建失败，本次不提供汇总查询\n");
+        }
+    }
 
     int choice;
     do {
+        report_new_overdue();
         printf("\n菜鸟驿站管理系统\n");
         printf("1. 用户管理\n");
         printf("2. 包裹管理\n");
         printf("3. 库存管理\n");
         printf("4. 财务统计\n");
         printf("5. 生成报表\n");
+        printf("6. 后台导出报表\n");
         printf("0. 退出系统\n");
         printf("请选择操作: ");
         scanf("%d", &choice);
@@ -827,24 +3900,15 @@ int main() {
         case 3: inventory_check(); break;
         case 4: financial_management(); break;
         case 5: generate_reports(); break;
+        case 6: export_reports(); break;
         case 0:
+            stop_accrual_timer();
+            close_store(); // 等待后台导出等快照释放
             save_all_data();
+            trace_close();
+            stop_event_consumer();
             // 释放内存
-            while (users) {
-                User* temp = users;
-                users = users->next;
-                free(temp);
-            }
-            while (packages) {
-                Package* temp = packages;
-                packages = packages->next;
-                free(temp);
-            }
-            while (finances) {
-                Finance* temp = finances;
-                finances = finances->next;
-                free(temp);
-            }
+            free_all_data();
             printf("数据已保存，系统安全退出！\n");
             exit(0);
         default: printf("无效选择!\n");